@@ -21,6 +21,11 @@
  * limitations under the License.
  */
 
+#ifdef __linux__
+/* for sendmmsg() and recvmmsg() */
+#define _GNU_SOURCE
+#endif
+
 #include <string.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -30,6 +35,7 @@
 #include <ws2ipdef.h>
 #else
 #include <netdb.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #endif
@@ -45,7 +51,9 @@ const uint16_t _E131_PREAMBLE_SIZE = 0x0010;
 const uint16_t _E131_POSTAMBLE_SIZE = 0x0000;
 const uint8_t _E131_ACN_PID[] = {0x41, 0x53, 0x43, 0x2d, 0x45, 0x31, 0x2e, 0x31, 0x37, 0x00, 0x00, 0x00};
 const uint32_t _E131_ROOT_VECTOR = 0x00000004;
+const uint32_t _E131_ROOT_VECTOR_EXTENDED = 0x00000008;
 const uint32_t _E131_FRAME_VECTOR = 0x00000002;
+const uint32_t _E131_FRAME_VECTOR_SYNC = 0x00000001;
 const uint8_t _E131_DMP_VECTOR = 0x02;
 const uint8_t _E131_DMP_TYPE = 0xa1;
 const uint16_t _E131_DMP_FIRST_ADDR = 0x0000;
@@ -79,6 +87,11 @@ int e131_bind(int sockfd, const uint16_t port) {
   return bind(sockfd, (struct sockaddr *)&addr, sizeof addr);
 }
 
+/* Set the size of a socket file descriptor's receive buffer */
+int e131_recv_buffer(int sockfd, int size) {
+  return setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const char *)&size, sizeof size);
+}
+
 /* Initialize a unicast E1.31 destination using a host and port number */
 int e131_unicast_dest(e131_addr_t *dest, const char *host, const uint16_t port) {
   if (dest == NULL || host == NULL) {
@@ -202,15 +215,127 @@ int e131_set_option(e131_packet_t *packet, const e131_option_t option, const boo
   return 0;
 }
 
+/* Set the universe of the sync packets that an E1.31 packet waits for */
+int e131_set_sync_universe(e131_packet_t *packet, const uint16_t sync_universe) {
+  if (packet == NULL || sync_universe > 63999) {
+    errno = EINVAL;
+    return -1;
+  }
+  packet->frame.sync_universe = htons(sync_universe);
+  return 0;
+}
+
+/* Initialize an E1.31 synchronization packet using a sync universe */
+int e131_sync_pkt_init(e131_sync_packet_t *packet, const uint16_t sync_universe) {
+  if (packet == NULL || sync_universe < 1 || sync_universe > 63999) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // compute packet layer lengths
+  uint16_t frame_length = sizeof packet->frame;
+  uint16_t root_length = sizeof packet->root.flength +
+    sizeof packet->root.vector + sizeof packet->root.cid + frame_length;
+
+  // clear packet
+  memset(packet, 0, sizeof *packet);
+
+  // set Root Layer values
+  packet->root.preamble_size = htons(_E131_PREAMBLE_SIZE);
+  packet->root.postamble_size = htons(_E131_POSTAMBLE_SIZE);
+  memcpy(packet->root.acn_pid, _E131_ACN_PID, sizeof packet->root.acn_pid);
+  packet->root.flength = htons(0x7000 | root_length);
+  packet->root.vector = htonl(_E131_ROOT_VECTOR_EXTENDED);
+
+  // set Synchronization Framing Layer values
+  packet->frame.flength = htons(0x7000 | frame_length);
+  packet->frame.vector = htonl(_E131_FRAME_VECTOR_SYNC);
+  packet->frame.sync_universe = htons(sync_universe);
+
+  return 0;
+}
+
+/* Get the length in bytes of an E1.31 packet as it is sent */
+size_t e131_pkt_length(const e131_packet_t *packet) {
+  return sizeof packet->raw - sizeof packet->dmp.prop_val + htons(packet->dmp.prop_val_cnt);
+}
+
 /* Send an E1.31 packet to a socket file descriptor using a destination */
 ssize_t e131_send(int sockfd, const e131_packet_t *packet, const e131_addr_t *dest) {
   if (packet == NULL || dest == NULL) {
     errno = EINVAL;
     return -1;
   }
-  const size_t packet_length = sizeof packet->raw -
-    sizeof packet->dmp.prop_val + htons(packet->dmp.prop_val_cnt);
-  return sendto(sockfd, packet->raw, packet_length, 0,
+  return sendto(sockfd, packet->raw, e131_pkt_length(packet), 0,
+    (const struct sockaddr *)dest, sizeof *dest);
+}
+
+/* Send several E1.31 packets to a socket file descriptor, each to its own destination */
+int e131_send_batch(int sockfd, const e131_packet_t *const *packets, const e131_addr_t *const *dests, size_t count) {
+  if (packets == NULL || dests == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  enum { CHUNK_SIZE = 64 };
+  const void *bufs[CHUNK_SIZE];
+  size_t lens[CHUNK_SIZE];
+  int sent = 0;
+  for (size_t start = 0; start < count; start += CHUNK_SIZE) {
+    const size_t chunk = (count - start) < CHUNK_SIZE ? (count - start) : CHUNK_SIZE;
+    for (size_t i = 0; i < chunk; i++) {
+      bufs[i] = packets[start + i]->raw;
+      lens[i] = e131_pkt_length(packets[start + i]);
+    }
+    sent += e131_send_raw_batch(sockfd, bufs, lens, dests + start, chunk);
+  }
+  return sent;
+}
+
+/* Send several UDP datagrams of any format, each to its own destination */
+int e131_send_raw_batch(int sockfd, const void *const *bufs, const size_t *lens, const e131_addr_t *const *dests, size_t count) {
+  if (bufs == NULL || lens == NULL || dests == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  size_t sent = 0;
+  int failed = 0;
+#ifdef __linux__
+  /* hand the kernel as many packets at once as fit in these */
+  enum { BATCH_SIZE = 64 };
+  struct mmsghdr msgs[BATCH_SIZE];
+  struct iovec iovs[BATCH_SIZE];
+  while (sent < count) {
+    const size_t batch = (count - sent) < BATCH_SIZE ? (count - sent) : BATCH_SIZE;
+    for (size_t i = 0; i < batch; i++) {
+      iovs[i].iov_base = (void *)bufs[sent + i];
+      iovs[i].iov_len = lens[sent + i];
+      memset(&msgs[i], 0, sizeof msgs[i]);
+      msgs[i].msg_hdr.msg_name = (void *)dests[sent + i];
+      msgs[i].msg_hdr.msg_namelen = sizeof *dests[sent + i];
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    const int result = sendmmsg(sockfd, msgs, batch, 0);
+    /* on any error leave the rest to the one at a time path below, which reports each failure */
+    if (result <= 0)
+      break;
+    sent += result;
+  }
+#endif
+  for (; sent < count; sent++) {
+    if (sendto(sockfd, bufs[sent], lens[sent], 0, (const struct sockaddr *)dests[sent], sizeof *dests[sent]) < 0)
+      failed++;
+  }
+  return (int)(count - failed);
+}
+
+/* Send an E1.31 synchronization packet to a socket file descriptor using a destination */
+ssize_t e131_send_sync(int sockfd, const e131_sync_packet_t *packet, const e131_addr_t *dest) {
+  if (packet == NULL || dest == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return sendto(sockfd, packet->raw, sizeof packet->raw, 0,
     (const struct sockaddr *)dest, sizeof *dest);
 }
 
@@ -223,6 +348,66 @@ ssize_t e131_recv(int sockfd, e131_packet_t *packet) {
   return recv(sockfd, packet->raw, sizeof packet->raw, 0);
 }
 
+/* Receive up to count E1.31 packets that are already waiting on a socket file descriptor */
+int e131_recv_batch(int sockfd, e131_packet_t *packets, size_t *lengths, e131_addr_t *sources, size_t count) {
+  if (packets == NULL || lengths == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  size_t received = 0;
+#ifdef __linux__
+  enum { BATCH_SIZE = 64 };
+  struct mmsghdr msgs[BATCH_SIZE];
+  struct iovec iovs[BATCH_SIZE];
+  while (received < count) {
+    const size_t batch = (count - received) < BATCH_SIZE ? (count - received) : BATCH_SIZE;
+    for (size_t i = 0; i < batch; i++) {
+      iovs[i].iov_base = packets[received + i].raw;
+      iovs[i].iov_len = sizeof packets[received + i].raw;
+      memset(&msgs[i], 0, sizeof msgs[i]);
+      if (sources != NULL) {
+        msgs[i].msg_hdr.msg_name = &sources[received + i];
+        msgs[i].msg_hdr.msg_namelen = sizeof sources[received + i];
+      }
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    const int result = recvmmsg(sockfd, msgs, batch, MSG_DONTWAIT, NULL);
+    if (result < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return received > 0 ? (int)received : -1;
+    }
+    for (int i = 0; i < result; i++)
+      lengths[received + i] = msgs[i].msg_len;
+    received += result;
+    /* the socket is empty */
+    if ((size_t)result < batch)
+      break;
+  }
+#else
+  for (; received < count; received++) {
+    fd_set fds;
+    struct timeval tv = {0, 0};
+    FD_ZERO(&fds);
+    FD_SET(sockfd, &fds);
+    if (select(sockfd + 1, &fds, NULL, NULL, &tv) != 1)
+      break;
+#ifdef _WIN32
+    int addr_len = sizeof(e131_addr_t);
+#else
+    socklen_t addr_len = sizeof(e131_addr_t);
+#endif
+    const ssize_t len = recvfrom(sockfd, packets[received].raw, sizeof packets[received].raw, 0,
+      (struct sockaddr *)(sources != NULL ? &sources[received] : NULL), sources != NULL ? &addr_len : NULL);
+    if (len < 0)
+      return received > 0 ? (int)received : -1;
+    lengths[received] = len;
+  }
+#endif
+  return (int)received;
+}
+
 /* Validate that an E1.31 packet is well-formed */
 e131_error_t e131_pkt_validate(const e131_packet_t *packet) {
   if (packet == NULL)
@@ -248,6 +433,14 @@ e131_error_t e131_pkt_validate(const e131_packet_t *packet) {
   return E131_ERR_NONE;
 }
 
+/* Check if an E1.31 packet is an extended one, synchronization or universe discovery */
+bool e131_pkt_is_extended(const e131_packet_t *packet) {
+  if (packet == NULL)
+    return false;
+  return memcmp(packet->root.acn_pid, _E131_ACN_PID, sizeof packet->root.acn_pid) == 0 &&
+    ntohl(packet->root.vector) == _E131_ROOT_VECTOR_EXTENDED;
+}
+
 /* Check if an E1.31 packet should be discarded (sequence number out of order) */
 bool e131_pkt_discard(const e131_packet_t *packet, const uint8_t last_seq_number) {
   if (packet == NULL)
@@ -279,7 +472,7 @@ int e131_pkt_dump(FILE *stream, const e131_packet_t *packet) {
   fprintf(stream, "  Layer Vector ........... %" PRIu32 "\n", ntohl(packet->frame.vector));
   fprintf(stream, "  Source Name ............ %s\n", packet->frame.source_name);
   fprintf(stream, "  Packet Priority ........ %" PRIu8 "\n", packet->frame.priority);
-  fprintf(stream, "  Reserved ............... %" PRIu16 "\n", ntohs(packet->frame.reserved));
+  fprintf(stream, "  Sync Universe .......... %" PRIu16 "\n", ntohs(packet->frame.sync_universe));
   fprintf(stream, "  Sequence Number ........ %" PRIu8 "\n", packet->frame.seq_number);
   fprintf(stream, "  Options Flags .......... %" PRIu8 "\n", packet->frame.options);
   fprintf(stream, "  DMX Universe Number .... %" PRIu16 "\n", ntohs(packet->frame.universe));
@@ -77,7 +77,7 @@ typedef union {
       uint32_t vector;           /* Layer Vector */
       uint8_t  source_name[64];  /* User Assigned Name of Source (UTF-8) */
       uint8_t  priority;         /* Packet Priority (0-200, default 100) */
-      uint16_t reserved;         /* Reserved (should be always 0) */
+      uint16_t sync_universe;    /* Synchronization Address (universe of the sync packets, 0 for none) */
       uint8_t  seq_number;       /* Sequence Number (detect duplicates or out of order packets) */
       uint8_t  options;          /* Options Flags (bit 7: preview data, bit 6: stream terminated) */
       uint16_t universe;         /* DMX Universe Number */
@@ -97,6 +97,31 @@ typedef union {
   uint8_t raw[638]; /* raw buffer view: 638 bytes */
 } e131_packet_t;
 
+/* E1.31 Synchronization Packet Type */
+/* Tells the receivers to output the data they are holding for the packets with this sync universe */
+typedef union {
+  PACK(struct {
+    PACK(struct { /* ACN Root Layer: 38 bytes */
+      uint16_t preamble_size;    /* Preamble Size */
+      uint16_t postamble_size;   /* Post-amble Size */
+      uint8_t  acn_pid[12];      /* ACN Packet Identifier */
+      uint16_t flength;          /* Flags (high 4 bits) & Length (low 12 bits) */
+      uint32_t vector;           /* Layer Vector */
+      uint8_t  cid[16];          /* Component Identifier (UUID) */
+    }) root;
+
+    PACK(struct { /* Synchronization Framing Layer: 11 bytes */
+      uint16_t flength;          /* Flags (high 4 bits) & Length (low 12 bits) */
+      uint32_t vector;           /* Layer Vector */
+      uint8_t  seq_number;       /* Sequence Number (detect duplicates or out of order packets) */
+      uint16_t sync_universe;    /* Synchronization Address */
+      uint16_t reserved;         /* Reserved (should be always 0) */
+    }) frame;
+  });
+
+  uint8_t raw[49]; /* raw buffer view: 49 bytes */
+} e131_sync_packet_t;
+
 /* E1.31 Framing Options Type */
 typedef enum {
   E131_OPT_TERMINATED = 6,
@@ -124,6 +149,9 @@ extern int e131_socket(void);
 /* Bind a socket file descriptor to a port number for E1.31 communication */
 extern int e131_bind(int sockfd, const uint16_t port);
 
+/* Set the size of a socket file descriptor's receive buffer, so bursts of many universes aren't dropped */
+extern int e131_recv_buffer(int sockfd, int size);
+
 /* Initialize a unicast E1.31 destination using a host and port number */
 extern int e131_unicast_dest(e131_addr_t *dest, const char *host, const uint16_t port);
 
@@ -145,15 +173,45 @@ extern bool e131_get_option(const e131_packet_t *packet, const e131_option_t opt
 /* Set the state of a framing option in an E1.31 packet */
 extern int e131_set_option(e131_packet_t *packet, const e131_option_t option, const bool state);
 
+/* Set the universe of the sync packets that an E1.31 packet waits for, 0 to output it straight away */
+extern int e131_set_sync_universe(e131_packet_t *packet, const uint16_t sync_universe);
+
+/* Initialize an E1.31 synchronization packet using a sync universe */
+extern int e131_sync_pkt_init(e131_sync_packet_t *packet, const uint16_t sync_universe);
+
+/* Get the length in bytes of an E1.31 packet as it is sent */
+extern size_t e131_pkt_length(const e131_packet_t *packet);
+
 /* Send an E1.31 packet to a socket file descriptor using a destination */
 extern ssize_t e131_send(int sockfd, const e131_packet_t *packet, const e131_addr_t *dest);
 
+/* Send several E1.31 packets to a socket file descriptor, each to its own destination, using
+   as few system calls as possible (sendmmsg on Linux). Returns the number of packets sent */
+extern int e131_send_batch(int sockfd, const e131_packet_t *const *packets, const e131_addr_t *const *dests, size_t count);
+
+/* Send several UDP datagrams of any format, each to its own destination, the same way as
+   e131_send_batch(). Returns the number of datagrams sent */
+extern int e131_send_raw_batch(int sockfd, const void *const *bufs, const size_t *lens, const e131_addr_t *const *dests, size_t count);
+
+/* Send an E1.31 synchronization packet to a socket file descriptor using a destination */
+extern ssize_t e131_send_sync(int sockfd, const e131_sync_packet_t *packet, const e131_addr_t *dest);
+
 /* Receive an E1.31 packet from a socket file descriptor */
 extern ssize_t e131_recv(int sockfd, e131_packet_t *packet);
 
+/* Receive up to count E1.31 packets that are already waiting on a socket file descriptor without
+   blocking, using as few system calls as possible (recvmmsg on Linux). The length of each packet
+   is stored in lengths and, if sources isn't NULL, the address it came from in sources. Returns
+   the number of packets received, 0 if none are waiting */
+extern int e131_recv_batch(int sockfd, e131_packet_t *packets, size_t *lengths, e131_addr_t *sources, size_t count);
+
 /* Validate that an E1.31 packet is well-formed */
 extern e131_error_t e131_pkt_validate(const e131_packet_t *packet);
 
+/* Check if an E1.31 packet is an extended one, synchronization or universe discovery, rather than
+   DMX data. These don't pass e131_pkt_validate() as they have a different layout */
+extern bool e131_pkt_is_extended(const e131_packet_t *packet);
+
 /* Check if an E1.31 packet should be discarded (sequence number out of order) */
 extern bool e131_pkt_discard(const e131_packet_t *packet, const uint8_t last_seq_number);
 
@@ -0,0 +1,54 @@
+#include "animationclock.hpp"
+
+namespace icosahedron
+{
+
+void AnimationClock::reset()
+{
+  m_start = Clock::now();
+  m_stepBaseTime = 0.0;
+  m_stepBaseFrame = 0;
+  m_time = 0.0;
+  m_deltaTime = 0.0;
+  m_frame = -1;
+}
+
+void AnimationClock::setRealTime()
+{
+  if(!isFixedStep())
+    return;
+  m_step = 0.0;
+  // carry on from the current time rather than jumping to the time since the reset.
+  m_start = Clock::now() - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_time));
+}
+
+void AnimationClock::setFixedStep(double step)
+{
+  if(step <= 0.0) {
+    setRealTime();
+    return;
+  }
+  if(step == m_step)
+    return;
+  m_step = step;
+  // before the first tick the first frame is at 0, otherwise the next one is a step on.
+  m_stepBaseTime = m_frame < 0 ? 0.0 : m_time;
+  m_stepBaseFrame = m_frame < 0 ? 0 : m_frame;
+}
+
+double AnimationClock::tick()
+{
+  m_frame++;
+  double t;
+  if(isFixedStep()) {
+    // multiplied out rather than summed so the error doesn't build up over a long show.
+    t = m_stepBaseTime + double(m_frame - m_stepBaseFrame) * m_step;
+  } else {
+    t = std::chrono::duration<double>(Clock::now() - m_start).count();
+  }
+  m_deltaTime = m_frame == 0 ? 0.0 : t - m_time;
+  m_time = t;
+  return t;
+}
+
+}
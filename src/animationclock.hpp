@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace icosahedron {
+
+/// The time that the patterns are animated at.
+///
+/// In real time mode each tick() reads the monotonic clock. In fixed step mode frame n is at
+/// exactly n times the step, however long the frames take, so the same pattern and parameters
+/// always give the same frames. That is what offline rendering and comparing frames between runs
+/// need.
+class AnimationClock {
+public:
+  AnimationClock() { reset(); }
+
+  /// Goes back to time 0, the next tick() is frame 0.
+  void reset();
+
+  /// Ticks follow the monotonic clock from the last reset().
+  void setRealTime();
+
+  /// Each tick advances by step seconds. Changing the step carries on from the current time.
+  void setFixedStep(double step);
+
+  bool isFixedStep() const { return m_step > 0.0; }
+  double step() const { return m_step; }
+
+  /// Advances to the next frame and returns its time in seconds.
+  double tick();
+
+  /// Time of the current frame in seconds.
+  double time() const { return m_time; }
+
+  /// Seconds between the previous frame and the current one, 0 for the first frame.
+  double deltaTime() const { return m_deltaTime; }
+
+  /// Number of the current frame, -1 before the first tick().
+  int64_t frame() const { return m_frame; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  Clock::time_point m_start;
+  double m_step = 0.0;
+  /// Time and frame number that the fixed steps count from, so changing the step doesn't jump.
+  double m_stepBaseTime = 0.0;
+  int64_t m_stepBaseFrame = 0;
+
+  double m_time = 0.0;
+  double m_deltaTime = 0.0;
+  int64_t m_frame = -1;
+};
+
+}
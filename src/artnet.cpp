@@ -0,0 +1,205 @@
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "artnet.hpp"
+
+const uint8_t ARTNET_ID[8] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+const uint16_t ARTNET_OP_DMX = 0x5000;
+const uint16_t ARTNET_OP_SYNC = 0x5200;
+const uint8_t ARTNET_VERSION = 14;
+
+/// Packets read from the socket in one go by the receiver.
+const size_t ARTNET_RECEIVE_BATCH_SIZE = 64;
+
+/// Socket receive buffer the receiver asks for, the OS may limit it (net.core.rmem_max on Linux).
+const int ARTNET_RECEIVE_BUFFER_SIZE = 8 * 1024 * 1024;
+
+/// Is true if the packet starts with the Art-Net id and the opcode.
+template<typename T> static bool IsOpcode(const T& packet, uint16_t opcode)
+{
+  return memcmp(packet.id, ARTNET_ID, sizeof(packet.id)) == 0 && packet.opcode_lo == (opcode & 0xff) && packet.opcode_hi == (opcode >> 8);
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+void ArtNetUniverseSender::init(int firstUniverse, const std::vector<int>& slotCounts)
+{
+  m_packets.resize(slotCounts.size());
+  for(size_t n = 0; n<slotCounts.size(); n++) {
+    auto& packet = m_packets[n];
+    memset(&packet, 0, sizeof(packet));
+    memcpy(packet.id, ARTNET_ID, sizeof(packet.id));
+    packet.opcode_lo = ARTNET_OP_DMX & 0xff;
+    packet.opcode_hi = ARTNET_OP_DMX >> 8;
+    packet.version_lo = ARTNET_VERSION;
+    const int portAddress = (n + firstUniverse) & 0x7fff;
+    packet.sub_uni = portAddress & 0xff;
+    packet.net = portAddress >> 8;
+    // the length has to be even.
+    const int length = std::clamp((slotCounts[n] + 1) & ~1, 2, 512);
+    packet.length_hi = length >> 8;
+    packet.length_lo = length & 0xff;
+  }
+}
+
+bool ArtNetUniverseSender::open(const char *ipAddr)
+{
+  close();
+  if((m_fd = e131_socket()) < 0) {
+    std::cout << "Failed to create socket" << std::endl;
+    return false;
+  }
+
+  if(e131_unicast_dest(&m_dest, ipAddr, ARTNET_PORT) < 0) {
+    std::cout << "Failed to set Art-Net unicast destination" << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ArtNetUniverseSender::close()
+{
+  if(m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+size_t ArtNetUniverseSender::prepare(size_t count, uint16_t syncUniverse)
+{
+  if(m_fd < 0)
+    return 0;
+  count = std::min(count, m_packets.size());
+
+  m_batchBufs.clear();
+  m_batchLens.clear();
+  m_batchDests.clear();
+  for(size_t n = 0; n<count; n++) {
+    auto& packet = m_packets[n];
+    // each universe has its own sequence, which skips 0 as that turns it off.
+    packet.sequence = packet.sequence == 255 ? 1 : packet.sequence + 1;
+    m_batchBufs.push_back(packet.raw);
+    m_batchLens.push_back(sizeof(packet.raw) - sizeof(packet.data) + ((packet.length_hi << 8) | packet.length_lo));
+    m_batchDests.push_back(&m_dest);
+  }
+  return count;
+}
+
+void ArtNetUniverseSender::sendPrepared(size_t first, size_t num, bool batch)
+{
+  num = std::min(num, m_batchBufs.size() - std::min(first, m_batchBufs.size()));
+  if(m_fd < 0 || !num)
+    return;
+
+  if(batch) {
+    if(e131_send_raw_batch(m_fd, &m_batchBufs[first], &m_batchLens[first], &m_batchDests[first], num) < int(num))
+      std::cout << "Art-Net sending failed" << std::endl;
+    return;
+  }
+
+  for(size_t n = first; n<first + num; n++) {
+    if(e131_send_raw_batch(m_fd, &m_batchBufs[n], &m_batchLens[n], &m_batchDests[n], 1) < 1)
+      std::cout << "Art-Net sending failed" << std::endl;
+  }
+}
+
+void ArtNetUniverseSender::sendSync(uint16_t syncUniverse)
+{
+  // Art-Net sync isn't numbered, but only send it when sync is on as the nodes hold the data for
+  // it once they've seen one.
+  if(m_fd < 0 || !syncUniverse)
+    return;
+  artnet_sync_packet_t sync;
+  memset(&sync, 0, sizeof(sync));
+  memcpy(sync.id, ARTNET_ID, sizeof(sync.id));
+  sync.opcode_lo = ARTNET_OP_SYNC & 0xff;
+  sync.opcode_hi = ARTNET_OP_SYNC >> 8;
+  sync.version_lo = ARTNET_VERSION;
+
+  const void *buf = sync.raw;
+  const size_t len = sizeof(sync.raw);
+  const e131_addr_t *dest = &m_dest;
+  if(e131_send_raw_batch(m_fd, &buf, &len, &dest, 1) < 1)
+    std::cout << "Art-Net sync sending failed" << std::endl;
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+ArtNetUniverseReceiver::ArtNetUniverseReceiver()
+  : m_packets(ARTNET_RECEIVE_BATCH_SIZE),
+    m_lengths(ARTNET_RECEIVE_BATCH_SIZE),
+    m_sources(ARTNET_RECEIVE_BATCH_SIZE)
+{}
+
+bool ArtNetUniverseReceiver::open()
+{
+  close();
+  if((m_fd = e131_socket()) < 0) {
+    std::cout << "Failed to create socket" << std::endl;
+    return false;
+  }
+
+  if(e131_recv_buffer(m_fd, ARTNET_RECEIVE_BUFFER_SIZE) < 0)
+    std::cout << "Failed to set receive buffer size" << std::endl;
+
+  if(e131_bind(m_fd, ARTNET_PORT) < 0) {
+    std::cout << "Failed to bind to port " << ARTNET_PORT << std::endl;
+    close();
+    return false;
+  }
+
+  std::cout << "Art-Net receiver enabled" << std::endl;
+  return true;
+}
+
+void ArtNetUniverseReceiver::close()
+{
+  if(m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+void ArtNetUniverseReceiver::receive(const Callback& fn)
+{
+  if(m_fd < 0)
+    return;
+
+  const size_t headerSize = sizeof(artnet_dmx_packet_t) - sizeof(artnet_dmx_packet_t::data);
+  while(1) {
+    const int count = e131_recv_batch(m_fd, m_packets.data(), m_lengths.data(), m_sources.data(), m_packets.size());
+    if(count < 0)
+      return;
+
+    for(int n = 0; n<count; n++) {
+      const auto& packet = *reinterpret_cast<const artnet_dmx_packet_t *>(m_packets[n].raw);
+      // ignore everything but ArtDmx, such as polls and syncs.
+      if(m_lengths[n] < headerSize || !IsOpcode(packet, ARTNET_OP_DMX))
+	continue;
+      const int length = std::min<int>((packet.length_hi << 8) | packet.length_lo, m_lengths[n] - headerSize);
+
+      // Art-Net has no identifier for the sender, so use its address.
+      uint8_t source[16] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+      memcpy(&source[8], &m_sources[n].sin_addr, sizeof(m_sources[n].sin_addr));
+
+      ReceivedUniverse universe;
+      universe.m_source = source;
+      universe.m_universe = ((packet.net & 0x7f) << 8) | packet.sub_uni;
+      universe.m_sequence = packet.sequence;
+      universe.m_hasSequence = packet.sequence != 0;
+      universe.m_data = packet.data;
+      universe.m_count = length;
+      fn(universe);
+    }
+
+    if(count < int(m_packets.size()))
+      return;
+  }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include <e131.h>
+
+#include "transport.hpp"
+
+/// UDP port that Art-Net uses for everything.
+const uint16_t ARTNET_PORT = 6454;
+
+/// An ArtDmx packet, one universe of DMX data.
+typedef union {
+  PACK(struct {
+    uint8_t  id[8];              /* "Art-Net" and a zero */
+    uint8_t  opcode_lo;          /* ARTNET_OP_DMX, little endian */
+    uint8_t  opcode_hi;
+    uint8_t  version_hi;         /* Protocol version, big endian */
+    uint8_t  version_lo;
+    uint8_t  sequence;           /* 1-255 for each universe in turn, 0 to disable reordering */
+    uint8_t  physical;           /* Input port the data came from, informational */
+    uint8_t  sub_uni;            /* Low 8 bits of the 15 bit port address */
+    uint8_t  net;                /* High 7 bits of the port address */
+    uint8_t  length_hi;          /* Number of slots, even and 2-512, big endian */
+    uint8_t  length_lo;
+    uint8_t  data[512];          /* DMX slots from slot 1, there is no start code */
+  });
+
+  uint8_t raw[530];
+} artnet_dmx_packet_t;
+
+/// An ArtSync packet, which tells the nodes to show the ArtDmx data they are holding.
+typedef union {
+  PACK(struct {
+    uint8_t  id[8];
+    uint8_t  opcode_lo;          /* ARTNET_OP_SYNC, little endian */
+    uint8_t  opcode_hi;
+    uint8_t  version_hi;
+    uint8_t  version_lo;
+    uint8_t  aux1;
+    uint8_t  aux2;
+  });
+
+  uint8_t raw[14];
+} artnet_sync_packet_t;
+
+/// Sends universes with Art-Net. Art-Net numbers universes from 0, so universe n in the mapping
+/// file is port address n.
+class ArtNetUniverseSender : public UniverseSender {
+public:
+  ~ArtNetUniverseSender() override { close(); }
+
+  void init(int firstUniverse, const std::vector<int>& slotCounts) override;
+  bool open(const char *ipAddr) override;
+  void close() override;
+  int numUniverses() const override { return m_packets.size(); }
+  uint8_t *slots(int n) override { return m_packets[n].data; }
+  bool hasStartCode() const override { return false; }
+  size_t prepare(size_t count, uint16_t syncUniverse) override;
+  void sendPrepared(size_t first, size_t num, bool batch) override;
+  void sendSync(uint16_t syncUniverse) override;
+
+private:
+  int m_fd = -1;
+  e131_addr_t m_dest;
+  std::vector<artnet_dmx_packet_t> m_packets;
+  /// The packets from prepare(), as e131_send_raw_batch() takes them. Kept to save allocating
+  /// them every frame.
+  std::vector<const void *> m_batchBufs;
+  std::vector<size_t> m_batchLens;
+  std::vector<const e131_addr_t *> m_batchDests;
+};
+
+/// Receives ArtDmx packets. Port address n is universe n, as it is for the sender, so port
+/// address 0 is never used. Art-Net has no priorities so every sender gets the default.
+class ArtNetUniverseReceiver : public UniverseReceiver {
+public:
+  ArtNetUniverseReceiver();
+  ~ArtNetUniverseReceiver() override { close(); }
+
+  bool open() override;
+  void close() override;
+  void receive(const Callback& fn) override;
+
+private:
+  int m_fd = -1;
+  /// Buffers that each batch of packets is read into, E1.31 packets are bigger than ArtDmx ones.
+  std::vector<e131_packet_t> m_packets;
+  std::vector<size_t> m_lengths;
+  std::vector<e131_addr_t> m_sources;
+};
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "bakecache.hpp"
+
+namespace icosahedron
+{
+
+/// Baked frames are stored with this gamma rather than in linear light, so each step is about
+/// one output level once the senders' colour correction raises them to 1/gamma at its default.
+/// In linear light the smallest step would come out at level 20 and everything below it at 0.
+static const float BAKE_GAMMA = 2.2f;
+
+static void EncodeLights(const LightBuffer& lights, uint8_t *out)
+{
+  const size_t count = lights.size();
+  for(int c = 0; c<3; c++) {
+    const float *in = lights.plane(c);
+    uint8_t *o = out + c * count;
+    for(size_t n = 0; n<count; n++) {
+      // written so that NaN ends up as 0.
+      const float t = in[n] > 0.0f ? (in[n] < 1.0f ? in[n] : 1.0f) : 0.0f;
+      o[n] = uint8_t(std::pow(t, 1.0f / BAKE_GAMMA) * 255.0f + 0.5f);
+    }
+  }
+}
+
+static void DecodeLights(const uint8_t *in, LightBuffer& lights)
+{
+  static const std::array<float, 256> table = [] {
+    std::array<float, 256> t;
+    for(int i = 0; i<256; i++)
+      t[i] = std::pow(i / 255.0f, BAKE_GAMMA);
+    return t;
+  }();
+
+  const size_t count = lights.size();
+  for(int c = 0; c<3; c++) {
+    const uint8_t *i = in + c * count;
+    float *o = lights.plane(c);
+    for(size_t n = 0; n<count; n++)
+      o[n] = table[i[n]];
+  }
+}
+
+void BakeCache::Key::set(int pattern, float period, int frameRate, const PatternFrame& frame, size_t numLights)
+{
+  m_pattern = pattern;
+  m_period = period;
+  m_frameRate = frameRate;
+  m_arg = frame.m_arg;
+  m_insideOutsideMix = frame.m_insideOutsideMix;
+  m_numLights = numLights;
+  m_params.assign(frame.m_params, frame.m_params + frame.m_nParams);
+  if(frame.m_topology)
+    m_sides.assign(frame.sides(), frame.sides() + frame.m_topology->size());
+  else
+    m_sides.clear();
+}
+
+void BakeCache::Job::bake()
+{
+  const int numFrames = std::max(1L, std::lround(m_key.m_period * m_key.m_frameRate));
+  const size_t frameSize = m_positions.size() * 3;
+  m_frames.resize(numFrames * frameSize);
+
+  // the frames are spread evenly over exactly one period, so the last one leads back into the
+  // first even when the period isn't a whole number of frames.
+  LightBuffer colours(m_positions.size());
+  for(int n = 0; n<numFrames && !m_cancel.load(std::memory_order_relaxed); n++) {
+    m_frame.m_time = n * double(m_key.m_period) / numFrames;
+    AnimateLightColours(*m_pattern, m_positions, colours, m_frame);
+    EncodeLights(colours, &m_frames[n * frameSize]);
+  }
+  m_done.store(true, std::memory_order_release);
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+BakeCache::~BakeCache()
+{
+  cancelJob();
+}
+
+void BakeCache::setFrameRate(int rateHz)
+{
+  m_frameRate = std::max(rateHz, 1);
+}
+
+void BakeCache::setPeriod(float seconds)
+{
+  m_period = std::max(seconds, 0.0f);
+}
+
+void BakeCache::invalidate()
+{
+  cancelJob();
+  m_baked = false;
+  m_frames.clear();
+  m_frames.shrink_to_fit();
+  m_numFrames = 0;
+  m_steadyFrames = 0;
+}
+
+bool BakeCache::lookup(int patternIndex, const Pattern& pattern, const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours)
+{
+  if(m_job && m_job->m_done.load(std::memory_order_acquire))
+    finishJob();
+
+  const float period = m_period > 0.0f ? m_period : pattern.loopPeriod(frame);
+  if(period <= 0.0f || frame.m_time < 0.0f) {
+    cancelJob();
+    m_steadyFrames = 0;
+    return false;
+  }
+
+  // filled in every frame, but it reuses its vectors so a steady show doesn't allocate.
+  const size_t numLights = positions.size();
+  m_current.set(patternIndex, period, m_frameRate, frame, numLights);
+  if(m_baked && m_current == m_bakedKey && colours.size() == numLights) {
+    replay(frame.m_time, colours);
+    return true;
+  }
+
+  if(m_current == m_pending) {
+    m_steadyFrames++;
+  } else {
+    m_pending = m_current;
+    m_steadyFrames = 1;
+  }
+
+  if(m_job && !(m_job->m_key == m_pending))
+    cancelJob();
+
+  // wait for the settings to stop changing, such as while a slider is being dragged, before
+  // spending time on a loop that may not be used.
+  const int STEADY_FRAMES = std::max(1, m_frameRate / 2);
+  const size_t bytes = size_t(std::lround(period * m_frameRate)) * numLights * 3;
+  if(!m_job && m_steadyFrames >= STEADY_FRAMES && bytes <= MAX_BYTES)
+    startJob(frame, positions);
+
+  if(!m_background && m_job) {
+    finishJob();
+    if(colours.size() == numLights) {
+      replay(frame.m_time, colours);
+      return true;
+    }
+  }
+  return false;
+}
+
+void BakeCache::replay(float time, LightBuffer& colours) const
+{
+  // the nearest baked frame, which wraps round to the first one at the end of the loop.
+  const double period = m_bakedKey.m_period;
+  const int n = int(std::fmod(double(time), period) / period * m_numFrames + 0.5) % m_numFrames;
+  DecodeLights(&m_frames[n * colours.size() * 3], colours);
+}
+
+void BakeCache::startJob(const PatternFrame& frame, const LightBuffer& positions)
+{
+  m_job = std::make_unique<Job>();
+  auto& job = *m_job;
+  job.m_key = m_pending;
+  // a new instance, so the baking doesn't touch the state of the one being shown.
+  job.m_pattern = PatternRegistry::Instance().create(m_pending.m_pattern);
+  job.m_positions = positions;
+  job.m_frame = frame;
+  job.m_frame.m_params = job.m_key.m_params.data();
+  if(frame.m_topology) {
+    job.m_topology = *frame.m_topology;
+    job.m_frame.m_topology = &job.m_topology;
+  }
+  if(frame.m_grid) {
+    job.m_grid = *frame.m_grid;
+    job.m_frame.m_grid = &job.m_grid;
+  }
+
+  if(m_background)
+    job.m_thread = std::thread(&Job::bake, &job);
+  else
+    job.bake();
+}
+
+void BakeCache::finishJob()
+{
+  if(m_job->m_thread.joinable())
+    m_job->m_thread.join();
+  m_bakedKey = m_job->m_key;
+  m_frames = std::move(m_job->m_frames);
+  m_numFrames = std::max(1L, std::lround(m_bakedKey.m_period * m_bakedKey.m_frameRate));
+  m_baked = true;
+  m_job.reset();
+}
+
+void BakeCache::cancelJob()
+{
+  if(!m_job)
+    return;
+  m_job->m_cancel = true;
+  if(m_job->m_thread.joinable())
+    m_job->m_thread.join();
+  m_job.reset();
+}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "lightbuffer.hpp"
+#include "lighttopology.hpp"
+#include "patterns.hpp"
+#include "spatialgrid.hpp"
+
+namespace icosahedron {
+
+/// Renders one loop of a pattern whose frames repeat into memory and replays it, so a looping
+/// pattern costs a copy per frame instead of evaluating every light.
+///
+/// The loop is held as 8 bit frames at a fixed frame rate, in planes like a frame file but gamma
+/// encoded so the dark end keeps about as many levels as the senders' output has. It is only
+/// used while the pattern and everything in the PatternFrame apart from the time are the same as
+/// when it was baked, any change goes back to evaluating the pattern until the new settings have
+/// been steady for long enough to be worth baking again.
+class BakeCache {
+public:
+  /// Loops longer than this many bytes aren't baked.
+  static const size_t MAX_BYTES = 64 * 1024 * 1024;
+
+  BakeCache() {}
+  ~BakeCache();
+
+  BakeCache(const BakeCache&) = delete;
+  BakeCache& operator=(const BakeCache&) = delete;
+
+  /// Frames per second that loops are baked at.
+  void setFrameRate(int rateHz);
+
+  /// Bakes on a background thread while the pattern carries on being evaluated, rather than
+  /// baking in lookup() as soon as the settings are known.
+  void setBackground(bool background) { m_background = background; }
+
+  /// Sets the loop period to use instead of the pattern's own, 0 uses the pattern's. This is how
+  /// patterns that only nearly repeat are baked, with a jump at the end of each loop.
+  void setPeriod(float seconds);
+
+  /// If the frames of the pattern at patternIndex in the registry are baked for frame's settings,
+  /// writes the one at frame.m_time into colours and returns true. Otherwise it returns false and
+  /// the pattern needs animating as usual; once the settings have stayed the same for a while the
+  /// loop is baked, on the background thread if that's enabled.
+  bool lookup(int patternIndex, const Pattern& pattern, const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours);
+
+  /// Throws the baked loop away, for when something the key doesn't cover changes such as the
+  /// topology after a mapping file has been read.
+  void invalidate();
+
+  /// Is true while a loop is being baked in the background.
+  bool baking() const { return m_job != nullptr; }
+
+  /// Period and memory of the loop being replayed, 0 if there isn't one.
+  float period() const { return m_baked ? m_bakedKey.m_period : 0.0f; }
+  size_t bytes() const { return m_baked ? m_frames.size() : 0; }
+
+private:
+  /// Everything that the baked frames depend on apart from the time.
+  struct Key {
+    int m_pattern = -1;
+    float m_period = 0.0f;
+    int m_frameRate = 0;
+    int m_arg = 0;
+    float m_insideOutsideMix = 0.0f;
+    size_t m_numLights = 0;
+    std::vector<float> m_params;
+    std::vector<uint8_t> m_sides;
+
+    /// Fills the key in from the frame, reusing the vectors' memory.
+    void set(int pattern, float period, int frameRate, const PatternFrame& frame, size_t numLights);
+    bool operator==(const Key&) const = default;
+  };
+
+  /// A loop being baked, with copies of everything it needs so it doesn't share anything with
+  /// the caller.
+  struct Job {
+    Key m_key;
+    std::unique_ptr<Pattern> m_pattern;
+    PatternFrame m_frame;
+    LightBuffer m_positions;
+    LightTopology m_topology;
+    SpatialGrid m_grid;
+    std::vector<uint8_t> m_frames;
+    std::atomic<bool> m_cancel{false};
+    std::atomic<bool> m_done{false};
+    std::thread m_thread;
+
+    void bake();
+  };
+
+  /// Starts baking m_pending, or bakes it straight away when not in the background.
+  void startJob(const PatternFrame& frame, const LightBuffer& positions);
+
+  /// Writes the baked frame nearest to time into colours.
+  void replay(float time, LightBuffer& colours) const;
+
+  /// Takes the frames of a finished background job.
+  void finishJob();
+
+  /// Cancels and waits for the background job.
+  void cancelJob();
+
+  int m_frameRate = 50;
+  bool m_background = true;
+  float m_period = 0.0f;
+
+  /// The settings of the current frame.
+  Key m_current;
+  /// The settings that the last frames had, and how many frames in a row they've been the same.
+  Key m_pending;
+  int m_steadyFrames = 0;
+
+  std::unique_ptr<Job> m_job;
+
+  bool m_baked = false;
+  Key m_bakedKey;
+  /// The baked frames one after the other, each laid out as QuantiseLights() writes them but
+  /// gamma encoded.
+  std::vector<uint8_t> m_frames;
+  int m_numFrames = 0;
+};
+
+}
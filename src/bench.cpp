@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtc/noise.hpp>
+
+#include "icosahedron.hpp"
+#include "noise.hpp"
+#include "simd.hpp"
+#include "patterns.hpp"
+#include "spatialgrid.hpp"
+#include "threadpool.hpp"
+#include "network.hpp"
+
+// Micro benchmarks for the patterns, the batch kernels and the senders' packing, run without any
+// of the GL code and without sending anything. Each runs on the real rig of 2,520 lights and then
+// on synthetic rigs of up to a million, to see what bigger installs would cost.
+//
+// The results are CSV, one row per benchmark and rig size:
+//
+//   ns_per_frame    time for all the lights once
+//   ns_per_light    ns_per_frame divided by the lights, and mlights_per_s and fps from it
+//   bytes_per_light the data the benchmark streams through for each light, not counting tables
+//                   that stay in the cache whatever the size
+//   working_set_kb  bytes_per_light for all the lights, and fits_in the smallest cache that holds
+//                   it, from the sizes the OS reports
+//   gb_per_s        bytes_per_light streamed per second, to compare with the memory bandwidth
+//   vs_smallest     ns_per_light over that of the same benchmark on the real rig, which rises
+//                   once the working set no longer fits in the cache
+//   max_diff        for the noise kernels, the largest difference from glm::perlin
+//
+// nice-lights-bench [options]
+//
+//   --seconds n     least time to run each benchmark for, 0.25 by default
+//   --max-lights n  largest rig to run, 1000000 by default
+//   --only name     only run the benchmarks whose name contains name
+//   --threads n     threads for the multithreaded pattern runs, one per core by default
+//   --csv file      write the results to file rather than the standard output, which the senders
+//                   also print their setup messages to
+
+using namespace icosahedron;
+
+namespace {
+
+double g_minSeconds = 0.25;
+
+/// Where the results go.
+FILE *g_csv = stdout;
+
+/// Runs fn until at least g_minSeconds have passed and returns the average time per call in
+/// nanoseconds.
+double TimeIt(const std::function<void()>& fn)
+{
+  fn();
+  int iterations = 1;
+  for(;;) {
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i<iterations; i++)
+      fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if(elapsed.count() >= g_minSeconds)
+      return elapsed.count() * 1e9 / iterations;
+    iterations *= 2;
+  }
+}
+
+/// Sizes of the data caches, 0 where the OS doesn't say.
+struct CacheSizes {
+  long m_l1 = 0;
+  long m_l2 = 0;
+  long m_l3 = 0;
+
+  CacheSizes() {
+#if !defined(_WIN32) && defined(_SC_LEVEL1_DCACHE_SIZE)
+    m_l1 = std::max(0L, sysconf(_SC_LEVEL1_DCACHE_SIZE));
+    m_l2 = std::max(0L, sysconf(_SC_LEVEL2_CACHE_SIZE));
+    m_l3 = std::max(0L, sysconf(_SC_LEVEL3_CACHE_SIZE));
+#endif
+  }
+
+  const char *fits(double bytes) const {
+    if(!m_l1 && !m_l2 && !m_l3)
+      return "";
+    if(bytes <= m_l1)
+      return "L1";
+    if(bytes <= m_l2)
+      return "L2";
+    if(bytes <= m_l3)
+      return "L3";
+    return "DRAM";
+  }
+};
+
+/// Writes the CSV rows, remembering each benchmark's time per light on the smallest rig.
+class Report {
+public:
+  void header() const {
+    fprintf(g_csv, "benchmark,variant,threads,lights,ns_per_frame,ns_per_light,mlights_per_s,fps,"
+	    "bytes_per_light,working_set_kb,fits_in,gb_per_s,vs_smallest,max_diff\n");
+  }
+
+  void row(const std::string& benchmark, const std::string& variant, int threads, int lights, double ns, double bytesPerLight, double maxDiff = -1.0) {
+    const double nsPerLight = ns / lights;
+    const std::string key = benchmark + "," + variant + "," + std::to_string(threads);
+    const double smallest = m_smallest.emplace(key, nsPerLight).first->second;
+    const double workingSet = bytesPerLight * lights;
+    fprintf(g_csv, "%s,%s,%i,%i,%.0f,%.3f,%.2f,%.1f,%.0f,%.1f,%s,%.2f,%.2f,",
+	    benchmark.c_str(), variant.c_str(), threads, lights, ns, nsPerLight, 1e3 / nsPerLight, 1e9 / ns,
+	    bytesPerLight, workingSet / 1024.0, m_caches.fits(workingSet), workingSet / ns, nsPerLight / smallest);
+    if(maxDiff >= 0.0)
+      fprintf(g_csv, "%g", maxDiff);
+    fprintf(g_csv, "\n");
+    fflush(g_csv);
+  }
+
+private:
+  CacheSizes m_caches;
+  std::map<std::string, double> m_smallest;
+};
+
+/// The sender with everything update() does apart from the sending itself.
+class PackingSender : public NetworkMultiSender {
+public:
+  /// Latches the settings, packs the lights and writes them into the packets.
+  void pack(const LightBuffer& lights) {
+    startFrame();
+    packLights(lights, {0, int(lights.size())});
+    for(auto& host : m_hosts)
+      writePackets(host);
+  }
+};
+
+/// Light positions and topology to benchmark with: the real rig for a count of 0, otherwise count
+/// lights made of copies of the real rig with every light moved a little at random, so the copies
+/// don't sit on top of each other. Each copy has the real rig's edges and sides, so the patterns
+/// that look at them do the same work per light as they do on the rig.
+void MakeRig(int count, LightBuffer& positions, LightTopology& topology)
+{
+  LightBuffer rig, colours;
+  LightTopology rigTopology;
+  MakeIcosahedronLightPoints(rig, colours, rigTopology);
+  positions.clear();
+  topology.clear();
+  if(count == 0) {
+    positions = rig;
+    topology = rigTopology;
+    return;
+  }
+
+  unsigned seed = 1;
+  auto rnd = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return float(seed >> 8) / float(1 << 24) * 2.0f - 1.0f;
+  };
+  const float JITTER = 0.05f;
+  for(int n = 0; n<count; n++) {
+    const int src = n % rig.size();
+    positions.push_back(rig.get(src) + glm::vec3(rnd(), rnd(), rnd()) * JITTER);
+    topology.push_back(rigTopology.m_edge[src], rigTopology.m_side[src], rigTopology.m_alongEdge[src]);
+  }
+}
+
+/// A mapping file for count lights, driven the way the rig is: controllers of ten strings of
+/// NUM_LEDS_PER_EDGE lights, alternately reversed, each with its own run of universes.
+std::string MakeMapping(int count)
+{
+  const int STRINGS_PER_HOST = 10;
+  const int lightsPerHost = NUM_LEDS_PER_EDGE * STRINGS_PER_HOST;
+  std::ostringstream mapping;
+  int universe = 1;
+  for(int first = 0, h = 0; first<count; first += lightsPerHost, h++) {
+    const int hostLights = std::min(lightsPerHost, count - first);
+    mapping << "host bench-" << h << " " << universe << "\n";
+    for(int s = 0; s * NUM_LEDS_PER_EDGE < hostLights; s++) {
+      const int begin = first + s * NUM_LEDS_PER_EDGE;
+      const int end = std::min(begin + NUM_LEDS_PER_EDGE, first + hostLights);
+      mapping << (s & 1 ? "r " : "i ") << begin << " " << end << " bench-" << h << " " << begin - first << "\n";
+    }
+    // the sender gives each host one E1.31 universe for every 170 lights, and one more.
+    universe += hostLights / 170 + 1;
+  }
+  return mapping.str();
+}
+
+bool Selected(const std::string& only, const std::string& name)
+{
+  return only.empty() || name.find(only) != std::string::npos;
+}
+
+void BenchNoise(Report& report, const LightBuffer& positions)
+{
+  const int count = positions.size();
+  const float *px = positions.x();
+  const float *pz = positions.z();
+  const float z = 12.34f;
+  std::vector<float> reference(count), out(count);
+
+  // what the plasma patterns used to do.
+  double ns = TimeIt([&]() {
+    for(int n = 0; n<count; n++)
+      reference[n] = glm::perlin(glm::vec3(px[n] * 10.0, pz[n] * 10.0, z));
+  });
+  report.row("glm::perlin", "-", 1, count, ns, 12);
+
+  std::vector<float> x(count), y(count), zs(count, z);
+  for(int n = 0; n<count; n++) {
+    x[n] = px[n] * 10.0f;
+    y[n] = pz[n] * 10.0f;
+  }
+  NoiseField field;
+  field.build(px, pz, count, 10.0f);
+
+  const SimdLevel supported = GetSupportedSimdLevel();
+  for(int l = int(SimdLevel::Scalar); l<=int(supported); l++) {
+    SetSimdLevel(SimdLevel(l));
+    const char *level = GetSimdLevelName(SimdLevel(l));
+
+    ns = TimeIt([&]() { PerlinNoiseBatch(x.data(), y.data(), zs.data(), out.data(), count); });
+    float maxDiff = 0.0f;
+    for(int n = 0; n<count; n++)
+      maxDiff = std::max(maxDiff, std::fabs(out[n] - reference[n]));
+    report.row("PerlinBatch", level, 1, count, ns, 16, maxDiff);
+
+    // the cell positions, fades and corner hashes it keeps, and the output.
+    ns = TimeIt([&]() { field.evaluate(z, 0, count, out.data()); });
+    maxDiff = 0.0f;
+    for(int n = 0; n<count; n++)
+      maxDiff = std::max(maxDiff, std::fabs(out[n] - reference[n]));
+    report.row("NoiseField", level, 1, count, ns, 36, maxDiff);
+  }
+  SetSimdLevel(supported);
+}
+
+/// Every pattern for whole frames, each a 60th of a second after the last, on one thread and
+/// then on the pool.
+void BenchPatterns(Report& report, const std::string& only, const LightBuffer& positions, const LightTopology& topology, ThreadPool& pool)
+{
+  const int count = positions.size();
+  SpatialGrid grid;
+  grid.build(positions);
+  LightBuffer colours(count);
+
+  const float params[6] = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+  PatternFrame frame;
+  frame.m_arg = 1;
+  frame.m_params = params;
+  frame.m_nParams = 6;
+  frame.m_topology = &topology;
+  frame.m_grid = &grid;
+
+  // the positions read and the colours cleared, written and mixed, and the sides.
+  const double BYTES_PER_LIGHT = 12 + 12 + 1;
+  const auto& registry = PatternRegistry::Instance();
+  for(int p = 0; p<registry.count(); p++) {
+    const std::string name = registry.name(p);
+    if(!Selected(only, name))
+      continue;
+    auto pattern = registry.create(p);
+    frame.m_time = 0.0f;
+    double ns = TimeIt([&]() {
+      frame.m_time += 1.0f / 60.0f;
+      AnimateLightColours(*pattern, positions, colours, frame);
+    });
+    report.row(name, "-", 1, count, ns, BYTES_PER_LIGHT);
+
+    if(pool.threadCount() > 1) {
+      ns = TimeIt([&]() {
+	frame.m_time += 1.0f / 60.0f;
+	AnimateLightColours(*pattern, positions, colours, frame, pool);
+      });
+      report.row(name, "-", pool.threadCount(), count, ns, BYTES_PER_LIGHT);
+    }
+  }
+
+  if(Selected(only, "MixInsideOutside")) {
+    for(int n = 0; n<count; n++)
+      colours.set(n, glm::vec3(0.25f, 0.5f, 0.75f));
+    // the mix is 0.5 so the colours stay the same however many times it runs.
+    const double ns = TimeIt([&]() { MixInsideOutside(colours, 0.5f, topology.m_side.data(), {0, count}); });
+    report.row("MixInsideOutside", "-", 1, count, ns, 12 + 1);
+  }
+}
+
+/// The senders' packing of a frame into their packets, without sending them.
+void BenchSenders(Report& report, const std::string& only, const LightBuffer& positions)
+{
+  const int count = positions.size();
+  LightBuffer colours(count);
+  for(int n = 0; n<count; n++) {
+    const glm::vec3 p = positions.get(n);
+    colours.set(n, glm::clamp(p * 0.5f + 0.5f, 0.0f, 1.0f));
+  }
+
+  if(Selected(only, "NetworkMultiSender::update")) {
+    PackingSender sender;
+    std::istringstream mapping(MakeMapping(count));
+    sender.readRanges(mapping);
+    // the colours, the mapping table, the full precision slots and the packets.
+    sender.m_dither = false;
+    double ns = TimeIt([&]() { sender.pack(colours); });
+    report.row("NetworkMultiSender::update", "8 bit", 1, count, ns, 12 + 8 + 6 + 3);
+    // as above and the dither error carried over.
+    sender.m_dither = true;
+    ns = TimeIt([&]() { sender.pack(colours); });
+    report.row("NetworkMultiSender::update", "dithered", 1, count, ns, 12 + 8 + 6 + 3 + 3);
+  }
+
+  if(Selected(only, "NetworkSender::sendFrame")) {
+    NetworkSender sender;
+    sender.initPackets(count);
+    // the colours and the packets.
+    const double ns = TimeIt([&]() { sender.packLights(colours, {0, count}); });
+    report.row("NetworkSender::sendFrame", "-", 1, count, ns, 12 + 3);
+  }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  int maxLights = 1000000;
+  int threads = 0;
+  std::string only;
+  for(int n = 1; n<argc; n++) {
+    const std::string arg = argv[n];
+    auto value = [&]() -> const char * {
+      if(n + 1 >= argc) {
+	fprintf(stderr, "%s needs a value\n", arg.c_str());
+	exit(1);
+      }
+      return argv[++n];
+    };
+    if(arg == "--seconds")
+      g_minSeconds = std::max(0.001, atof(value()));
+    else if(arg == "--max-lights")
+      maxLights = atoi(value());
+    else if(arg == "--only")
+      only = value();
+    else if(arg == "--threads")
+      threads = std::max(0, atoi(value()));
+    else if(arg == "--csv") {
+      const char *filename = value();
+      g_csv = fopen(filename, "w");
+      if(!g_csv) {
+	fprintf(stderr, "Failed to create %s\n", filename);
+	return 1;
+      }
+    } else {
+      fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  ThreadPool pool(threads);
+  fprintf(stderr, "best SIMD level: %s, %i threads\n", GetSimdLevelName(GetSupportedSimdLevel()), pool.threadCount());
+
+  Report report;
+  report.header();
+
+  LightBuffer positions;
+  LightTopology topology;
+  // the rig, then four times bigger each step up to a million.
+  for(int count : {0, 10080, 40320, 161280, 1000000}) {
+    if(count > maxLights)
+      break;
+    MakeRig(count, positions, topology);
+    fprintf(stderr, "%lu lights\n", positions.size());
+    if(Selected(only, "glm::perlin") || Selected(only, "PerlinBatch") || Selected(only, "NoiseField"))
+      BenchNoise(report, positions);
+    BenchPatterns(report, only, positions, topology, pool);
+    BenchSenders(report, only, positions);
+  }
+
+  if(g_csv != stdout)
+    fclose(g_csv);
+  return 0;
+}
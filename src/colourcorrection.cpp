@@ -0,0 +1,66 @@
+#include <cmath>
+#include <algorithm>
+
+#include "simd.hpp"
+#include "colourcorrection.hpp"
+
+#ifdef NICE_LIGHTS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace icosahedron
+{
+
+void ColourCorrection::build()
+{
+  const float invGamma = 1.0f / std::max(m_params.m_gamma, 0.01f);
+  for(int c = 0; c<3; c++) {
+    const float scale = std::clamp(m_params.m_white[c], 0.0f, 1.0f) * std::clamp(m_params.m_maxBrightness, 0.0f, 1.0f);
+    for(int i = 0; i<LUT_SIZE; i++) {
+      const float f = float(i) / float(LUT_SIZE - 1);
+      // the top 8 bits truncate like the old per light conversion did.
+      m_lut[c][i] = uint16_t(std::pow(f, invGamma) * scale * (255.0f * 256.0f));
+    }
+  }
+}
+
+// The values are at most 255 << 8 so adding an error of up to 255 can't overflow 16 bits, and the
+// top 8 bits of the sum can be stored without clamping.
+
+#ifdef NICE_LIGHTS_X86_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+static int TemporalDitherSSE2(const uint16_t *value, uint8_t *error, uint8_t *out, int count)
+{
+  const __m128i low = _mm_set1_epi16(0xff);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m128i err = _mm_loadu_si128((const __m128i *)(error + i));
+    __m128i sumLo = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(value + i)), _mm_unpacklo_epi8(err, zero));
+    __m128i sumHi = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(value + i + 8)), _mm_unpackhi_epi8(err, zero));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(_mm_srli_epi16(sumLo, 8), _mm_srli_epi16(sumHi, 8)));
+    _mm_storeu_si128((__m128i *)(error + i), _mm_packus_epi16(_mm_and_si128(sumLo, low), _mm_and_si128(sumHi, low)));
+  }
+  return i;
+}
+#pragma GCC pop_options
+
+#endif
+
+void TemporalDither(const uint16_t *value, uint8_t *error, uint8_t *out, int count)
+{
+  int i = 0;
+#ifdef NICE_LIGHTS_X86_SIMD
+  if(GetSimdLevel() >= SimdLevel::SSE2)
+    i = TemporalDitherSSE2(value, error, out, count);
+#endif
+  for(; i<count; i++) {
+    uint16_t sum = value[i] + error[i];
+    out[i] = sum >> 8;
+    error[i] = sum & 0xff;
+  }
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+namespace icosahedron {
+
+/// Calibration for the LEDs on one controller.
+struct ColourCorrectionParams {
+  float m_gamma = 2.2f;
+  /// Output of each channel at full brightness, for matching the white of different LED batches.
+  float m_white[3] = {1.0f, 1.0f, 1.0f};
+  /// Cap on the output of every channel as a fraction of full brightness.
+  float m_maxBrightness = 1.0f;
+
+  bool operator==(const ColourCorrectionParams&) const = default;
+};
+
+/// Lookup tables from a light's 0-1 colour channels to the values sent to a controller, applying
+/// the gamma curve, white point and brightness cap. The tables are only rebuilt when the
+/// parameters change so the per light cost is a clamp and a load.
+///
+/// The tables hold 8.8 fixed point values so that the fraction that 8 bit output loses can be
+/// kept for TemporalDither().
+class ColourCorrection {
+public:
+  /// Number of entries in each table, enough that neighbouring entries are rarely more than one
+  /// output step apart except right at the bottom of the curve.
+  static const int LUT_SIZE = 4096;
+
+  ColourCorrection() { build(); }
+
+  /// Rebuilds the tables if the parameters are different to the ones they were built for.
+  void update(const ColourCorrectionParams& params) {
+    if(params == m_params)
+      return;
+    m_params = params;
+    build();
+  }
+
+  const ColourCorrectionParams& params() const { return m_params; }
+
+  /// The 8 bit output value of channel c for the colour f.
+  uint8_t lookup(int c, float f) const {
+    return lookupWide(c, f) >> 8;
+  }
+
+  /// The output value of channel c for the colour f as 8.8 fixed point, at most 255 << 8.
+  uint16_t lookupWide(int c, float f) const {
+    // written so that NaN ends up as 0.
+    const float t = f > 0.0f ? (f < 1.0f ? f : 1.0f) : 0.0f;
+    return m_lut[c][int(t * float(LUT_SIZE - 1) + 0.5f)];
+  }
+
+private:
+  void build();
+
+  ColourCorrectionParams m_params;
+  uint16_t m_lut[3][LUT_SIZE];
+};
+
+/// Temporal dithering of 8.8 fixed point values, as made by ColourCorrection::lookupWide(), down to
+/// 8 bits. The fraction that each value loses is kept in error and added back the next time, so
+/// when the same values are sent repeatedly the average output has the full precision. error
+/// should start as zeros and be kept between calls.
+void TemporalDither(const uint16_t *value, uint8_t *error, uint8_t *out, int count);
+
+}
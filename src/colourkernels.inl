@@ -0,0 +1,97 @@
+// Colour space kernels shared by every instruction set in colourspace.cpp.
+//
+// This is included once per instruction set inside a namespace that provides the vector type V,
+// its WIDTH and the operations Load, Store, Set1, Add, Sub, Mul, Div, Min, Max, Floor and
+// Gather. Because the same source is used for every width the operations and their order are
+// identical, which is what makes the SIMD paths bit identical to the scalar one.
+
+static inline V Wrap(V x, float period)
+{
+  return Sub(x, Mul(Floor(Div(x, Set1(period))), Set1(period)));
+}
+
+static inline V HSVChannel(V hh, V vs, V v, float n)
+{
+  V k = Wrap(Add(Set1(n), hh), 6.0f);
+  V t = Min(Min(k, Sub(Set1(4.0f), k)), Set1(1.0f));
+  t = Max(t, Set1(0.0f));
+  return Sub(v, Mul(vs, t));
+}
+
+static inline void HSVtoRGBBlock(const float *h, const float *s, const float *v, float *r, float *g, float *b, int i)
+{
+  V hh = Div(Load(h + i), Set1(60.0f));
+  V vv = Load(v + i);
+  V vs = Mul(vv, Load(s + i));
+  V cr = HSVChannel(hh, vs, vv, 5.0f);
+  V cg = HSVChannel(hh, vs, vv, 3.0f);
+  V cb = HSVChannel(hh, vs, vv, 1.0f);
+  Store(r + i, cr);
+  Store(g + i, cg);
+  Store(b + i, cb);
+}
+
+static inline V HSLChannel(V hh, V a, V l, float n)
+{
+  V k = Wrap(Add(Set1(n), hh), 12.0f);
+  V t = Min(Min(Sub(k, Set1(3.0f)), Sub(Set1(9.0f), k)), Set1(1.0f));
+  t = Max(t, Set1(-1.0f));
+  return Sub(l, Mul(a, t));
+}
+
+static inline void HSLtoRGBBlock(const float *h, const float *s, const float *l, float *r, float *g, float *b, int i)
+{
+  V hh = Div(Load(h + i), Set1(30.0f));
+  V ll = Load(l + i);
+  V a = Mul(Load(s + i), Min(ll, Sub(Set1(1.0f), ll)));
+  V cr = HSLChannel(hh, a, ll, 0.0f);
+  V cg = HSLChannel(hh, a, ll, 8.0f);
+  V cb = HSLChannel(hh, a, ll, 4.0f);
+  Store(r + i, cr);
+  Store(g + i, cg);
+  Store(b + i, cb);
+}
+
+static inline void PaletteLookupBlock(const float *const planes[3], int size, const float *t, float *r, float *g, float *b, int i)
+{
+  V x = Load(t + i);
+  x = Mul(Sub(x, Floor(x)), Set1(float(size)));
+  V idx = Floor(x);
+  V f = Sub(x, idx);
+  V c[3];
+  for(int ch = 0; ch<3; ch++) {
+    V c0 = Gather(planes[ch], idx);
+    V c1 = Gather(planes[ch] + 1, idx);
+    c[ch] = Add(c0, Mul(Sub(c1, c0), f));
+  }
+  Store(r + i, c[0]);
+  Store(g + i, c[1]);
+  Store(b + i, c[2]);
+}
+
+// Each of these converts whole vectors from the start of the arrays and returns how many
+// colours were done, the caller finishes any remainder with the scalar versions.
+
+static int HSVtoRGBRun(const float *h, const float *s, const float *v, float *r, float *g, float *b, int count)
+{
+  int i = 0;
+  for(; i + WIDTH <= count; i += WIDTH)
+    HSVtoRGBBlock(h, s, v, r, g, b, i);
+  return i;
+}
+
+static int HSLtoRGBRun(const float *h, const float *s, const float *l, float *r, float *g, float *b, int count)
+{
+  int i = 0;
+  for(; i + WIDTH <= count; i += WIDTH)
+    HSLtoRGBBlock(h, s, l, r, g, b, i);
+  return i;
+}
+
+static int PaletteLookupRun(const float *const planes[3], int size, const float *t, float *r, float *g, float *b, int count)
+{
+  int i = 0;
+  for(; i + WIDTH <= count; i += WIDTH)
+    PaletteLookupBlock(planes, size, t, r, g, b, i);
+  return i;
+}
@@ -0,0 +1,94 @@
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+#include "simdops.hpp"
+#include "colourspace.hpp"
+
+namespace icosahedron
+{
+
+namespace simd_scalar {
+#include "colourkernels.inl"
+}
+
+#ifdef NICE_LIGHTS_X86_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+namespace simd_sse2 {
+#include "colourkernels.inl"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace simd_avx2 {
+#include "colourkernels.inl"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace simd_avx512 {
+#include "colourkernels.inl"
+}
+#pragma GCC pop_options
+
+#endif
+
+glm::vec3 HSVtoRGB(float H, float s, float v)
+{
+  glm::vec3 c;
+  simd_scalar::HSVtoRGBBlock(&H, &s, &v, &c.x, &c.y, &c.z, 0);
+  return c;
+}
+
+glm::vec3 HSLtoRGB(float H, float s, float l)
+{
+  glm::vec3 c;
+  simd_scalar::HSLtoRGBBlock(&H, &s, &l, &c.x, &c.y, &c.z, 0);
+  return c;
+}
+
+void HSVtoRGBBatch(const float *h, const float *s, const float *v, float *r, float *g, float *b, int count)
+{
+  int done = DISPATCH_RUN(HSVtoRGBRun, h, s, v, r, g, b, count);
+  simd_scalar::HSVtoRGBRun(h + done, s + done, v + done, r + done, g + done, b + done, count - done);
+}
+
+void HSLtoRGBBatch(const float *h, const float *s, const float *l, float *r, float *g, float *b, int count)
+{
+  int done = DISPATCH_RUN(HSLtoRGBRun, h, s, l, r, g, b, count);
+  simd_scalar::HSLtoRGBRun(h + done, s + done, l + done, r + done, g + done, b + done, count - done);
+}
+
+Palette::Palette(const std::vector<glm::vec3>& colours)
+  : m_size(std::max<int>(colours.size(), 1))
+{
+  for(int c = 0; c<3; c++) {
+    auto& plane = m_plane[c];
+    for(const auto& col : colours)
+      plane.push_back(col[c]);
+    if(colours.empty())
+      plane.push_back(0.0f);
+    // wrap round so that a lookup can always read the entry after the one it lands on, even
+    // when the position rounds up to exactly 1.
+    const float first = plane[0];
+    const float second = plane[m_size > 1 ? 1 : 0];
+    plane.push_back(first);
+    plane.push_back(second);
+  }
+}
+
+void PaletteLookupBatch(const Palette& palette, const float *t, float *r, float *g, float *b, int count)
+{
+  const float *planes[3] = {palette.plane(0), palette.plane(1), palette.plane(2)};
+  const int size = palette.size();
+  int done = DISPATCH_RUN(PaletteLookupRun, planes, size, t, r, g, b, count);
+  simd_scalar::PaletteLookupRun(planes, size, t + done, r + done, g + done, b + done, count - done);
+}
+
+}
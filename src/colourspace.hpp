@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "lightbuffer.hpp"
+
+namespace icosahedron {
+
+/// Converts one HSV colour to RGB. H is in degrees and wraps, s and v are 0-1. Gives exactly the
+/// same result as HSVtoRGBBatch does for the same inputs.
+glm::vec3 HSVtoRGB(float H, float s, float v);
+
+/// Converts one HSL colour to RGB. H is in degrees and wraps, s and l are 0-1.
+glm::vec3 HSLtoRGB(float H, float s, float l);
+
+/// Converts count HSV colours held as separate planes into separate r, g and b planes.
+///
+/// The best SIMD implementation for the CPU is picked at runtime, see simd.hpp. Every
+/// implementation, including the scalar one, performs the same single precision operations in
+/// the same order so they all give bit identical results. The outputs may be the same arrays
+/// as the inputs.
+void HSVtoRGBBatch(const float *h, const float *s, const float *v, float *r, float *g, float *b, int count);
+
+/// As HSVtoRGBBatch but for HSL colours.
+void HSLtoRGBBatch(const float *h, const float *s, const float *l, float *r, float *g, float *b, int count);
+
+/// A cyclic gradient through a list of colours, looked up with PaletteLookupBatch.
+class Palette {
+public:
+  /// An empty list of colours makes a palette of just black.
+  explicit Palette(const std::vector<glm::vec3>& colours);
+
+  int size() const { return m_size; }
+
+  /// Channel plane of the palette. It has two extra entries wrapping round to the start so
+  /// a lookup never needs to check the index.
+  const float *plane(int c) const { return m_plane[c].data(); }
+
+private:
+  int m_size;
+  AlignedFloatVector m_plane[3];
+};
+
+/// Looks up count positions in the palette, writing the colours to r, g and b planes. The
+/// positions wrap so that 0 and 1 are both the first colour, and colours in between are
+/// linearly interpolated.
+void PaletteLookupBatch(const Palette& palette, const float *t, float *r, float *g, float *b, int count);
+
+}
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "ddp.hpp"
+
+const uint8_t DDP_FLAGS_VERSION_1 = 0x40;
+const uint8_t DDP_FLAGS_PUSH = 0x01;
+/// RGB, 8 bits a component.
+const uint8_t DDP_TYPE_RGB24 = 0x0b;
+const uint8_t DDP_ID_DISPLAY = 1;
+const size_t DDP_HEADER_SIZE = sizeof(ddp_packet_t::raw) - DDP_MAX_DATA;
+
+void DDPUniverseSender::init(int firstUniverse, const std::vector<int>& slotCounts)
+{
+  m_slotStarts.clear();
+  m_dataLength = 0;
+  for(const int count : slotCounts) {
+    m_slotStarts.push_back(m_dataLength);
+    m_dataLength += count;
+  }
+  m_data.assign(m_dataLength + 512, 0);
+
+  m_packets.resize((m_dataLength + DDP_MAX_DATA - 1) / DDP_MAX_DATA);
+  for(size_t n = 0; n<m_packets.size(); n++) {
+    auto& packet = m_packets[n];
+    memset(&packet, 0, sizeof(packet));
+    packet.flags = DDP_FLAGS_VERSION_1;
+    packet.data_type = DDP_TYPE_RGB24;
+    packet.id = DDP_ID_DISPLAY;
+    packet.offset = htonl(n * DDP_MAX_DATA);
+    packet.length = htons(std::min(DDP_MAX_DATA, m_dataLength - n * DDP_MAX_DATA));
+  }
+}
+
+bool DDPUniverseSender::open(const char *ipAddr)
+{
+  close();
+  if((m_fd = e131_socket()) < 0) {
+    std::cout << "Failed to create socket" << std::endl;
+    return false;
+  }
+
+  if(e131_unicast_dest(&m_dest, ipAddr, DDP_PORT) < 0) {
+    std::cout << "Failed to set DDP unicast destination" << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void DDPUniverseSender::close()
+{
+  if(m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+void DDPUniverseSender::setSequence(ddp_packet_t& packet)
+{
+  m_sequence = m_sequence >= 15 ? 1 : m_sequence + 1;
+  packet.sequence = m_sequence;
+}
+
+size_t DDPUniverseSender::prepare(size_t count, uint16_t syncUniverse)
+{
+  if(m_fd < 0 || m_packets.empty())
+    return 0;
+  // count is in universes, send the packets that cover them.
+  const size_t length = count < m_slotStarts.size() ? m_slotStarts[count] : m_dataLength;
+  const size_t numPackets = std::min((length + DDP_MAX_DATA - 1) / DDP_MAX_DATA, m_packets.size());
+
+  m_batchBufs.clear();
+  m_batchLens.clear();
+  m_batchDests.clear();
+  for(size_t n = 0; n<numPackets; n++) {
+    auto& packet = m_packets[n];
+    const size_t packetLength = ntohs(packet.length);
+    memcpy(packet.data, &m_data[n * DDP_MAX_DATA], packetLength);
+    setSequence(packet);
+    packet.flags = DDP_FLAGS_VERSION_1;
+    // with sync the push comes from sendSync() once every host has its data.
+    if(n == numPackets - 1 && !syncUniverse)
+      packet.flags |= DDP_FLAGS_PUSH;
+    m_batchBufs.push_back(packet.raw);
+    m_batchLens.push_back(DDP_HEADER_SIZE + packetLength);
+    m_batchDests.push_back(&m_dest);
+  }
+  return numPackets;
+}
+
+void DDPUniverseSender::sendPrepared(size_t first, size_t num, bool batch)
+{
+  num = std::min(num, m_batchBufs.size() - std::min(first, m_batchBufs.size()));
+  if(m_fd < 0 || !num)
+    return;
+
+  if(batch) {
+    if(e131_send_raw_batch(m_fd, &m_batchBufs[first], &m_batchLens[first], &m_batchDests[first], num) < int(num))
+      std::cout << "DDP sending failed" << std::endl;
+    return;
+  }
+
+  for(size_t n = first; n<first + num; n++) {
+    if(e131_send_raw_batch(m_fd, &m_batchBufs[n], &m_batchLens[n], &m_batchDests[n], 1) < 1)
+      std::cout << "DDP sending failed" << std::endl;
+  }
+}
+
+void DDPUniverseSender::sendSync(uint16_t syncUniverse)
+{
+  if(m_fd < 0 || !syncUniverse)
+    return;
+  // a push with no data shows what the display has been sent.
+  ddp_packet_t push;
+  memset(push.raw, 0, DDP_HEADER_SIZE);
+  push.flags = DDP_FLAGS_VERSION_1 | DDP_FLAGS_PUSH;
+  push.data_type = DDP_TYPE_RGB24;
+  push.id = DDP_ID_DISPLAY;
+  setSequence(push);
+
+  const void *buf = push.raw;
+  const size_t len = DDP_HEADER_SIZE;
+  const e131_addr_t *dest = &m_dest;
+  if(e131_send_raw_batch(m_fd, &buf, &len, &dest, 1) < 1)
+    std::cout << "DDP push sending failed" << std::endl;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include <e131.h>
+
+#include "transport.hpp"
+
+/// UDP port that DDP displays listen on.
+const uint16_t DDP_PORT = 4048;
+
+/// Most pixel data in one DDP packet, 480 RGB lights, which is as much as WLED takes.
+const size_t DDP_MAX_DATA = 1440;
+
+/// A DDP data packet, the header and up to DDP_MAX_DATA bytes of pixel data.
+typedef union {
+  PACK(struct {
+    uint8_t  flags;              /* Version 1 and the push flag on the last packet of a frame */
+    uint8_t  sequence;           /* 1-15 in the low 4 bits, 0 to disable reordering */
+    uint8_t  data_type;          /* DDP_TYPE_RGB24 */
+    uint8_t  id;                 /* Destination, DDP_ID_DISPLAY for the lights */
+    uint32_t offset;             /* Byte offset of the data into the display, big endian */
+    uint16_t length;             /* Bytes of data, big endian */
+    uint8_t  data[DDP_MAX_DATA];
+  });
+
+  uint8_t raw[10 + DDP_MAX_DATA];
+} ddp_packet_t;
+
+/// Sends the lights to a WLED controller with DDP, which carries 480 lights to a packet rather
+/// than the 170 of a DMX universe. The slots of all the universes are one run of pixel data, so
+/// the start universe and packet offset don't apply.
+///
+/// Each frame ends with the push flag, which tells the display to show it. When sync is on the
+/// data is sent without it and sendSync() sends a packet that is only a push, so that every
+/// host shows the frame at once.
+class DDPUniverseSender : public UniverseSender {
+public:
+  ~DDPUniverseSender() override { close(); }
+
+  void init(int firstUniverse, const std::vector<int>& slotCounts) override;
+  bool open(const char *ipAddr) override;
+  void close() override;
+  int numUniverses() const override { return m_slotStarts.size(); }
+  uint8_t *slots(int n) override { return &m_data[m_slotStarts[n]]; }
+  bool hasStartCode() const override { return false; }
+  bool isDmx() const override { return false; }
+  size_t prepare(size_t count, uint16_t syncUniverse) override;
+  void sendPrepared(size_t first, size_t num, bool batch) override;
+  void sendSync(uint16_t syncUniverse) override;
+
+private:
+  /// Fills in the next sequence number, which is counted for every packet.
+  void setSequence(ddp_packet_t& packet);
+
+  int m_fd = -1;
+  e131_addr_t m_dest;
+  /// Where each universe's slots start in m_data.
+  std::vector<size_t> m_slotStarts;
+  /// Bytes of pixel data in the frame, all the universes' slots.
+  size_t m_dataLength = 0;
+  /// The pixel data of every universe end to end, with room for a whole universe after the last.
+  std::vector<uint8_t> m_data;
+  std::vector<ddp_packet_t> m_packets;
+  uint8_t m_sequence = 0;
+  /// The packets from prepare(), as e131_send_raw_batch() takes them. Kept to save allocating
+  /// them every frame.
+  std::vector<const void *> m_batchBufs;
+  std::vector<size_t> m_batchLens;
+  std::vector<const e131_addr_t *> m_batchDests;
+};
@@ -0,0 +1,216 @@
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <random>
+
+#include <unistd.h>
+
+#include "e131transport.hpp"
+
+/// Packets read from the socket in one go by the receiver.
+const size_t RECEIVE_BATCH_SIZE = 64;
+
+/// Socket receive buffer the receiver asks for, the OS may limit it (net.core.rmem_max on Linux).
+const int RECEIVE_BUFFER_SIZE = 8 * 1024 * 1024;
+
+/// Component identifier that the receivers tell this program's packets apart from other sources
+/// with, made up the first time it's needed.
+static const uint8_t *GetSourceCid()
+{
+  static uint8_t cid[16];
+  static bool once = []() {
+    std::random_device rnd;
+    for(auto& byte : cid)
+      byte = rnd();
+    // make it a version 4 UUID.
+    cid[6] = (cid[6] & 0x0f) | 0x40;
+    cid[8] = (cid[8] & 0x3f) | 0x80;
+    return true;
+  }();
+  return cid;
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+void E131UniverseSender::init(int firstUniverse, const std::vector<int>& slotCounts)
+{
+  m_packets.resize(slotCounts.size());
+  for(size_t n = 0; n<slotCounts.size(); n++) {
+    auto& packet = m_packets[n];
+    e131_pkt_init(&packet, n+firstUniverse, std::clamp(slotCounts[n], 1, 512));
+    strcpy((char *)&packet.frame.source_name, "NiceLights");                
+    memcpy(packet.root.cid, GetSourceCid(), sizeof(packet.root.cid));
+  }
+}
+
+bool E131UniverseSender::open(const char *ipAddr)
+{
+  close();
+  if((m_fd = e131_socket()) < 0) {
+    std::cout << "Failed to create socket" << std::endl;
+    return false;
+  }
+
+  if(e131_unicast_dest(&m_dest, ipAddr, E131_DEFAULT_PORT) < 0) {
+    std::cout << "Failed to set E131 unicast destination" << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void E131UniverseSender::close()
+{
+  if(m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+size_t E131UniverseSender::prepare(size_t count, uint16_t syncUniverse)
+{
+  if(m_fd < 0)
+    return 0;
+  count = std::min(count, m_packets.size());
+
+  // each universe has its own sequence.
+  m_batchPackets.clear();
+  m_batchDests.clear();
+  for(size_t n = 0; n<count; n++) {
+    m_packets[n].frame.seq_number++;
+    m_packets[n].frame.sync_universe = htons(syncUniverse);
+    m_batchPackets.push_back(&m_packets[n]);
+    m_batchDests.push_back(&m_dest);
+  }
+  return count;
+}
+
+void E131UniverseSender::sendPrepared(size_t first, size_t num, bool batch)
+{
+  num = std::min(num, m_batchPackets.size() - std::min(first, m_batchPackets.size()));
+  if(m_fd < 0 || !num)
+    return;
+
+  if(batch) {
+    if(e131_send_batch(m_fd, &m_batchPackets[first], &m_batchDests[first], num) < int(num))
+      std::cout << "E131 sending failed" << std::endl;
+    return;
+  }
+
+  for(size_t n = first; n<first + num; n++) {
+    if(e131_send(m_fd, m_batchPackets[n], &m_dest) < 0)
+      std::cout << "E131 sending failed" << std::endl;
+  }
+}
+
+void E131UniverseSender::sendSync(uint16_t syncUniverse)
+{
+  if(m_fd < 0 || !syncUniverse)
+    return;
+  e131_sync_packet_t sync;
+  e131_sync_pkt_init(&sync, syncUniverse);
+  memcpy(sync.root.cid, GetSourceCid(), sizeof(sync.root.cid));
+  sync.frame.seq_number = m_syncSeqNumber++;
+  if(e131_send_sync(m_fd, &sync, &m_dest) < 0)
+    std::cout << "E131 sync sending failed" << std::endl;
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+E131UniverseReceiver::E131UniverseReceiver()
+  : m_packets(RECEIVE_BATCH_SIZE),
+    m_lengths(RECEIVE_BATCH_SIZE)
+{}
+
+bool E131UniverseReceiver::open()
+{
+  close();
+  do {
+    if((m_fd = e131_socket()) < 0) {
+      std::cout << "Failed to create socket" << std::endl;
+      return false;
+    }
+
+    // a whole frame of hundreds of universes can arrive between updates.
+    if(e131_recv_buffer(m_fd, RECEIVE_BUFFER_SIZE) < 0)
+      std::cout << "Failed to set receive buffer size" << std::endl;
+                
+    if(e131_bind(m_fd, E131_DEFAULT_PORT) < 0) {
+      std::cout << "Failed to bind to port " << E131_DEFAULT_PORT << std::endl;
+      break;
+    }
+
+    /*
+      if(e131_multicast_join(m_fd, 1) < 0) {
+      std::cout << "Failed to join multicast group" << std::endl;
+      break;
+      }
+    */
+    std::cout << "E131 receiver enabled" << std::endl;
+    return true;
+  } while(0);
+
+  // fall through to here on error enabling.
+  close();
+  return false;
+}
+
+void E131UniverseReceiver::close()
+{
+  if(m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+void E131UniverseReceiver::receive(const Callback& fn)
+{
+  if(m_fd < 0)
+    return;
+
+  e131_error_t error;
+  while(1) {
+    // keep reading batches of packets until the socket is empty.
+    const int count = e131_recv_batch(m_fd, m_packets.data(), m_lengths.data(), nullptr, m_packets.size());
+    if(count < 0)
+      return;
+
+    for(int n = 0; n<count; n++) {
+      auto& packet = m_packets[n];
+      // sync packets from this or another sender, and universe discovery, carry no lights.
+      if(e131_pkt_is_extended(&packet))
+	continue;
+      if((error = e131_pkt_validate(&packet)) != E131_ERR_NONE) {
+	std::cout << "Failed E131 packet validate: " << e131_strerror(error) << std::endl;
+	continue;
+      }
+      if(m_lengths[n] < e131_pkt_length(&packet)) {
+	std::cout << "Truncated E131 packet received" << std::endl;
+	continue;
+      }
+                
+      //e131_pkt_dump(stderr, &packet);
+
+      ReceivedUniverse universe;
+      universe.m_source = packet.root.cid;
+      universe.m_universe = ntohs(packet.frame.universe);
+      universe.m_sequence = packet.frame.seq_number;
+      universe.m_hasSequence = true;
+      universe.m_priority = packet.frame.priority;
+      universe.m_terminated = e131_get_option(&packet, E131_OPT_TERMINATED);
+      // the basic sender puts the lights straight after the header, over the start code.
+      universe.m_data = packet.dmp.prop_val;
+      universe.m_count = ntohs(packet.dmp.prop_val_cnt);
+
+      //printf("Received packet %i %i\n", universe.m_universe, universe.m_count);
+
+      fn(universe);
+    }
+
+    if(count < int(m_packets.size()))
+      return;
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include <e131.h>
+
+#include "transport.hpp"
+
+/// Sends universes with E1.31 (sACN).
+class E131UniverseSender : public UniverseSender {
+public:
+  ~E131UniverseSender() override { close(); }
+
+  void init(int firstUniverse, const std::vector<int>& slotCounts) override;
+  bool open(const char *ipAddr) override;
+  void close() override;
+  int numUniverses() const override { return m_packets.size(); }
+  uint8_t *slots(int n) override { return m_packets[n].dmp.prop_val + 1; }
+  bool hasStartCode() const override { return true; }
+  size_t prepare(size_t count, uint16_t syncUniverse) override;
+  void sendPrepared(size_t first, size_t num, bool batch) override;
+  void sendSync(uint16_t syncUniverse) override;
+
+private:
+  int m_fd = -1;
+  e131_addr_t m_dest;
+  std::vector<e131_packet_t> m_packets;
+  uint8_t m_syncSeqNumber = 0;
+  /// The packets from prepare(), as e131_send_batch() takes them. Kept to save allocating them
+  /// every frame.
+  std::vector<const e131_packet_t *> m_batchPackets;
+  std::vector<const e131_addr_t *> m_batchDests;
+};
+
+/// Receives universes sent with E1.31.
+class E131UniverseReceiver : public UniverseReceiver {
+public:
+  E131UniverseReceiver();
+  ~E131UniverseReceiver() override { close(); }
+
+  bool open() override;
+  void close() override;
+  void receive(const Callback& fn) override;
+
+private:
+  int m_fd = -1;
+  /// Buffers that each batch of packets is read into, and their lengths.
+  std::vector<e131_packet_t> m_packets;
+  std::vector<size_t> m_lengths;
+};
@@ -0,0 +1,82 @@
+#include <cstring>
+
+#include "framefile.hpp"
+
+namespace icosahedron
+{
+
+void QuantiseLights(const LightBuffer& lights, uint8_t *out)
+{
+  const size_t count = lights.size();
+  for(int c = 0; c<3; c++) {
+    const float *in = lights.plane(c);
+    uint8_t *o = out + c * count;
+    for(size_t n = 0; n<count; n++) {
+      // written so that NaN ends up as 0.
+      const float t = in[n] > 0.0f ? (in[n] < 1.0f ? in[n] : 1.0f) : 0.0f;
+      o[n] = uint8_t(t * 255.0f + 0.5f);
+    }
+  }
+}
+
+void DequantiseLights(const uint8_t *in, LightBuffer& lights)
+{
+  const size_t count = lights.size();
+  for(int c = 0; c<3; c++) {
+    const uint8_t *i = in + c * count;
+    float *o = lights.plane(c);
+    for(size_t n = 0; n<count; n++)
+      o[n] = i[n] * (1.0f / 255.0f);
+  }
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+bool FrameFileWriter::open(const std::string& filename, size_t numLights, int frameRate)
+{
+  close();
+  m_file = fopen(filename.c_str(), "wb");
+  if(!m_file) {
+    printf("Failed to create %s\n", filename.c_str());
+    return false;
+  }
+
+  m_header = FrameFileHeader();
+  memcpy(m_header.m_magic, FrameFileHeader::MAGIC, sizeof(m_header.m_magic));
+  m_header.m_numLights = numLights;
+  m_header.m_frameRate = frameRate;
+  m_frame.resize(m_header.frameSize());
+  m_failed = fwrite(&m_header, sizeof(m_header), 1, m_file) != 1;
+  return !m_failed;
+}
+
+bool FrameFileWriter::close()
+{
+  if(!m_file)
+    return false;
+
+  // the header is written again now the number of frames is known.
+  if(fseek(m_file, 0, SEEK_SET) != 0 || fwrite(&m_header, sizeof(m_header), 1, m_file) != 1)
+    m_failed = true;
+  if(fclose(m_file) != 0)
+    m_failed = true;
+  m_file = nullptr;
+  return !m_failed;
+}
+
+bool FrameFileWriter::write(const LightBuffer& lights)
+{
+  if(!m_file || lights.size() != m_header.m_numLights)
+    return false;
+
+  QuantiseLights(lights, m_frame.data());
+  if(fwrite(m_frame.data(), m_frame.size(), 1, m_file) != 1) {
+    m_failed = true;
+    return false;
+  }
+  m_header.m_numFrames++;
+  return true;
+}
+
+}
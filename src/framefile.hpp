@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "lightbuffer.hpp"
+
+namespace icosahedron {
+
+/// Header at the start of a frame file. The frames follow it, each one a plane of 8 bit red
+/// values, then green, then blue, for FrameFileHeader::m_numLights lights. Everything is in the
+/// byte order of the machine that wrote it.
+struct FrameFileHeader {
+  static constexpr char MAGIC[8] = {'N', 'L', 'F', 'R', 'A', 'M', 'E', 'S'};
+  static const uint32_t VERSION = 1;
+
+  char m_magic[8];
+  uint32_t m_version = VERSION;
+  uint32_t m_numLights = 0;
+  /// Frames per second the frames were rendered at.
+  uint32_t m_frameRate = 0;
+  uint32_t m_numFrames = 0;
+
+  /// Bytes in each frame.
+  size_t frameSize() const { return size_t(m_numLights) * 3; }
+};
+
+/// Converts the colours to 8 bits, rounding to the nearest value, into planes of lights.size()
+/// bytes each as they are stored in a frame file.
+void QuantiseLights(const LightBuffer& lights, uint8_t *out);
+
+/// The reverse of QuantiseLights(), lights must already be the right size.
+void DequantiseLights(const uint8_t *in, LightBuffer& lights);
+
+/// Writes rendered frames to a frame file.
+class FrameFileWriter {
+public:
+  ~FrameFileWriter() { close(); }
+
+  /// Creates filename and writes a header for frames of numLights lights at frameRate.
+  bool open(const std::string& filename, size_t numLights, int frameRate);
+
+  /// Finishes the header with the number of frames written and closes the file. Returns false
+  /// if any of the writes failed.
+  bool close();
+
+  /// Appends a frame, which must have the number of lights given to open().
+  bool write(const LightBuffer& lights);
+
+  uint32_t numFrames() const { return m_header.m_numFrames; }
+
+private:
+  FILE *m_file = nullptr;
+  FrameFileHeader m_header;
+  std::vector<uint8_t> m_frame;
+  bool m_failed = false;
+};
+
+}
@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <csignal>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#include "icosahedron.hpp"
+#include "animationclock.hpp"
+#include "bakecache.hpp"
+#include "framefile.hpp"
+#include "showfile.hpp"
+#include "patterns.hpp"
+#include "threadpool.hpp"
+#include "spatialgrid.hpp"
+#include "network.hpp"
+#include "pacer.hpp"
+
+// Animates the lights and sends them to the rig without a window, GL or ImGui, so the show
+// machine doesn't spend a core drawing a preview nobody is watching. Without a mapping file it
+// only animates, which times the patterns on machines with no GPU.
+//
+// With --render it renders --seconds of the pattern at --rate as fast as it can into a frame file
+// instead, on the fixed step clock so the same options always give the same frames. A mapping
+// file is then only read for the sides of the lights, nothing is sent.
+//
+// With --record every frame is also appended to a show file, the packets as they were sent when
+// there's a mapping file and the lights otherwise. --play sends a show instead of animating, at
+// the rate it was recorded at. A show of packets needs the mapping file it was recorded with, one
+// of lights is mapped and corrected by whichever mapping file is given.
+//
+// nice-lights-headless [options] [mapping-file]
+//
+//   --pattern name|n   pattern to run, by name or index, the first by default
+//   --list             list the patterns and exit
+//   --rate fps         frames a second to animate and send, 50 by default
+//   --threads n        animation threads, one per core by default
+//   --seconds n        stop after this long, otherwise run until SIGINT or SIGTERM
+//   --fixed-step       animate frame n at n / rate seconds rather than at the time it is sent
+//   --render file      render --seconds (10 by default) into file rather than sending
+//   --bake             replay patterns that loop from memory once they've been rendered once
+//   --bake-period n    bake loops of n seconds, for patterns that don't say they loop
+//   --record file      record what is sent, or the lights without a mapping file, into a show
+//   --play file        play a show rather than animating
+//   --loop             play the show over and over until stopped
+//   --param n value    generic animation parameter n (1-6), 0.0-1.0
+//   --inside-outside v mix between the lights inside and outside the shape, 0.5 by default
+//   --edge n           edge the highlight pattern lights
+//   --gamma g          gamma the mapping file's hosts use unless they set their own
+//   --dither           temporal dithering
+//   --offset n         packet start offset, 1 for WLED by default
+//   --pace fraction    pace each frame's packets over this fraction of the frame interval
+//   --no-sync          don't send the sync universe from the mapping file
+//   --no-batch         send the packets one at a time
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+  std::string m_mappingFile;
+  std::string m_pattern;
+  int m_rate = 50;
+  int m_threads = 0;
+  float m_seconds = 0.0f;
+  bool m_fixedStep = false;
+  std::string m_renderFile;
+  bool m_bake = false;
+  float m_bakePeriod = 0.0f;
+  std::string m_recordFile;
+  std::string m_playFile;
+  bool m_loop = false;
+  float m_params[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  float m_insideOutside = 0.5f;
+  int m_edge = 1;
+  float m_gamma = 2.2f;
+  bool m_dither = false;
+  int m_offset = 1;
+  float m_pace = 0.0f;
+  bool m_sync = true;
+  bool m_batch = true;
+};
+
+/// Set from the signal handler to stop the main loop.
+std::atomic<bool> g_quit(false);
+
+void OnSignal(int)
+{
+  g_quit = true;
+}
+
+/// Finds a pattern by name or index, or returns -1.
+int FindPattern(const std::string& name)
+{
+  const auto& registry = icosahedron::PatternRegistry::Instance();
+  for(int n = 0; n<registry.count(); n++) {
+    if(name == registry.name(n))
+      return n;
+  }
+  char *end = nullptr;
+  const long n = strtol(name.c_str(), &end, 10);
+  if(!name.empty() && *end == 0 && n >= 0 && n < registry.count())
+    return n;
+  return -1;
+}
+
+class HeadlessApp {
+public:
+  explicit HeadlessApp(const Options& options)
+    : m_options(options),
+      m_threadPool(options.m_threads)
+  {}
+
+  /// Makes the lights and reads the mapping file, if there is one, and opens the senders.
+  bool init();
+
+  /// Animates and sends at the frame rate until stopped.
+  void run();
+
+  /// Renders the frames into the frame file as fast as possible.
+  bool render();
+
+  /// Sends the frames of the show file at the rate it was recorded at.
+  bool play();
+
+  /// Prints how long the frames took.
+  void report() const;
+
+private:
+  /// Animates one frame at time t, packing each chunk of lights for the senders as it's done.
+  void animateLights(float t);
+
+  /// Opens the show file for the lights, when recording them rather than the packets.
+  bool startRecordingLights();
+
+  /// Counts the frame that started at frameStart and sleeps until the next is due.
+  void waitForFrame(Clock::time_point frameStart, Clock::time_point& due, std::chrono::nanoseconds interval);
+
+  /// Layout of a show of lights, which can only be played with the same number of lights.
+  std::string lightsLayout() const;
+
+  const Options& m_options;
+  int m_patternIndex = 0;
+  std::unique_ptr<icosahedron::Pattern> m_pattern;
+  icosahedron::ThreadPool m_threadPool;
+  icosahedron::AnimationClock m_clock;
+  icosahedron::BakeCache m_bakeCache;
+
+  icosahedron::LightBuffer m_lightCol;
+  icosahedron::LightBuffer m_lightPos;
+  icosahedron::LightTopology m_lightTopology;
+  icosahedron::SpatialGrid m_lightGrid;
+
+  NetworkMultiSender m_netMultiSender;
+
+  /// Is true if the lights' sides come from the mapping file even though nothing is sent.
+  bool m_useMappedSides = false;
+
+  /// The show being recorded when it's the lights, and the 8 bit lights written to it.
+  icosahedron::ShowWriter m_lightsRecorder;
+  std::vector<uint8_t> m_recordFrame;
+
+  /// Frames animated, and those that finished after the next one was due.
+  long m_frames = 0;
+  long m_late = 0;
+  /// Total and longest time spent animating and sending a frame.
+  std::chrono::nanoseconds m_busy = std::chrono::nanoseconds::zero();
+  std::chrono::nanoseconds m_maxBusy = std::chrono::nanoseconds::zero();
+  std::chrono::duration<double> m_elapsed = std::chrono::duration<double>::zero();
+};
+
+bool HeadlessApp::init()
+{
+  const int pattern = FindPattern(m_options.m_pattern.empty() ? "0" : m_options.m_pattern);
+  if(pattern < 0) {
+    printf("Unknown pattern %s, --list shows them\n", m_options.m_pattern.c_str());
+    return false;
+  }
+  m_patternIndex = pattern;
+  m_pattern = icosahedron::PatternRegistry::Instance().create(pattern);
+  printf("Pattern %s\n", m_pattern->name());
+
+  // nothing changes while running, so the loop is baked in one go rather than in the background.
+  m_bakeCache.setFrameRate(m_options.m_rate);
+  m_bakeCache.setBackground(false);
+  m_bakeCache.setPeriod(m_options.m_bakePeriod);
+
+  icosahedron::MakeIcosahedronLightPoints(m_lightPos, m_lightCol, m_lightTopology);
+  m_lightGrid.build(m_lightPos);
+  printf("Light Point count %lu, %i animation threads\n", m_lightPos.size(), m_threadPool.threadCount());
+
+  if(m_options.m_mappingFile.empty())
+    return true;
+
+  if(!m_netMultiSender.readRangesFile(m_options.m_mappingFile))
+    return false;
+  m_netMultiSender.updateTopology(m_lightTopology);
+  if(!m_options.m_renderFile.empty()) {
+    m_useMappedSides = true;
+    return true;
+  }
+
+  // every frame animated is sent, the rate is the output rate.
+  m_netMultiSender.m_frameDivisor = 1;
+  m_netMultiSender.m_gamma = m_options.m_gamma;
+  m_netMultiSender.m_dither = m_options.m_dither;
+  m_netMultiSender.m_packetStartOffset = m_options.m_offset;
+  m_netMultiSender.m_batchSend = m_options.m_batch;
+  m_netMultiSender.m_sync = m_options.m_sync;
+  m_netMultiSender.m_pace = m_options.m_pace > 0.0f;
+  m_netMultiSender.m_paceFraction = m_options.m_pace;
+  m_netMultiSender.m_enabled = true;
+  m_netMultiSender.updateEnabled();
+  if(!m_options.m_recordFile.empty() && !m_netMultiSender.startRecording(m_options.m_recordFile, m_options.m_rate))
+    return false;
+  return true;
+}
+
+std::string HeadlessApp::lightsLayout() const
+{
+  return "lights " + std::to_string(m_lightCol.size()) + "\n";
+}
+
+bool HeadlessApp::startRecordingLights()
+{
+  if(m_options.m_recordFile.empty() || m_netMultiSender.recording())
+    return true;
+  m_recordFrame.resize(m_lightCol.size() * 3);
+  if(!m_lightsRecorder.open(m_options.m_recordFile, icosahedron::ShowFrameKind::Lights, m_options.m_rate, m_recordFrame.size(), lightsLayout()))
+    return false;
+  printf("Recording lights to %s\n", m_options.m_recordFile.c_str());
+  return true;
+}
+
+void HeadlessApp::waitForFrame(Clock::time_point frameStart, Clock::time_point& due, std::chrono::nanoseconds interval)
+{
+  const auto busy = Clock::now() - frameStart;
+  m_busy += busy;
+  m_maxBusy = std::max<std::chrono::nanoseconds>(m_maxBusy, busy);
+  m_frames++;
+
+  // a late frame starts the next one straight away rather than trying to catch up, the same
+  // as the output thread.
+  due += interval;
+  const auto now = Clock::now();
+  if(due < now) {
+    m_late++;
+    due = now;
+  }
+  SleepUntil(due);
+}
+
+void HeadlessApp::animateLights(float t)
+{
+  icosahedron::PatternFrame frame;
+  frame.m_time = t;
+  frame.m_arg = m_options.m_edge;
+  frame.m_params = m_options.m_params;
+  frame.m_nParams = sizeof(m_options.m_params)/sizeof(m_options.m_params[0]);
+  frame.m_insideOutsideMix = m_options.m_insideOutside;
+  frame.m_topology = &m_lightTopology;
+  frame.m_useMappedSides = m_useMappedSides || m_netMultiSender.m_enabled;
+  frame.m_grid = &m_lightGrid;
+
+  const bool send = m_netMultiSender.beginFrame();
+  if(m_options.m_bake && m_bakeCache.lookup(m_patternIndex, *m_pattern, frame, m_lightPos, m_lightCol)) {
+    if(send)
+      m_netMultiSender.packLights(m_lightCol, {0, int(m_lightCol.size())});
+  } else if(send) {
+    icosahedron::AnimateLightColours(*m_pattern,
+				     m_lightPos,
+				     m_lightCol,
+				     frame,
+				     m_threadPool,
+				     [&](const icosahedron::LightBuffer& colours, icosahedron::LightRange range) {
+				       m_netMultiSender.packLights(colours, range);
+				     });
+  } else
+    icosahedron::AnimateLightColours(*m_pattern, m_lightPos, m_lightCol, frame, m_threadPool);
+
+  if(!send)
+    return;
+
+  const std::chrono::nanoseconds interval(1000000000 / m_options.m_rate);
+  if(m_netMultiSender.m_pace)
+    m_netMultiSender.sendPackets(std::chrono::duration_cast<std::chrono::nanoseconds>(interval * std::clamp(m_netMultiSender.m_paceFraction, 0.0f, 1.0f)));
+  else
+    m_netMultiSender.sendPackets();
+}
+
+void HeadlessApp::run()
+{
+  const std::chrono::nanoseconds interval(1000000000 / m_options.m_rate);
+  if(m_options.m_fixedStep)
+    m_clock.setFixedStep(1.0 / m_options.m_rate);
+  m_clock.reset();
+  if(!startRecordingLights())
+    return;
+
+  const auto start = Clock::now();
+  auto due = start;
+  while(!g_quit) {
+    const auto frameStart = Clock::now();
+    const std::chrono::duration<float> elapsed = frameStart - start;
+    if(m_options.m_seconds > 0.0f && elapsed.count() >= m_options.m_seconds)
+      break;
+
+    animateLights(m_clock.tick());
+    if(m_lightsRecorder.isOpen()) {
+      icosahedron::QuantiseLights(m_lightCol, m_recordFrame.data());
+      if(!m_lightsRecorder.write(m_recordFrame.data())) {
+	printf("Failed to write to the show, stopping recording\n");
+	m_lightsRecorder.close();
+      }
+    }
+
+    waitForFrame(frameStart, due, interval);
+  }
+  m_elapsed = Clock::now() - start;
+
+  if(m_lightsRecorder.isOpen()) {
+    const size_t numFrames = m_lightsRecorder.numFrames();
+    if(m_lightsRecorder.close())
+      printf("Recorded %zu frames\n", numFrames);
+    else
+      printf("Failed to write the show\n");
+  }
+  m_netMultiSender.stopRecording();
+
+  if(m_netMultiSender.m_enabled) {
+    m_netMultiSender.m_enabled = false;
+    m_netMultiSender.updateEnabled();
+  }
+}
+
+bool HeadlessApp::play()
+{
+  icosahedron::ShowReader show;
+  if(!show.open(m_options.m_playFile))
+    return false;
+  const auto& header = show.header();
+  const bool packets = show.kind() == icosahedron::ShowFrameKind::Packets;
+  if(packets) {
+    if(!m_netMultiSender.m_enabled) {
+      printf("%s is packets, it needs the mapping file it was recorded with\n", m_options.m_playFile.c_str());
+      return false;
+    }
+    if(show.layout() != m_netMultiSender.packetLayout() || show.frameSize() != m_netMultiSender.packetFrameSize()) {
+      printf("%s was recorded with a different mapping file, for\n%s", m_options.m_playFile.c_str(), show.layout().c_str());
+      return false;
+    }
+  } else if(show.layout() != lightsLayout() || show.frameSize() != m_lightCol.size() * 3) {
+    printf("%s is of different lights, %s", m_options.m_playFile.c_str(), show.layout().c_str());
+    return false;
+  }
+  if(!show.numFrames() || header.m_frameRate == 0) {
+    printf("%s has no frames\n", m_options.m_playFile.c_str());
+    return false;
+  }
+  printf("Playing %zu frames of %s at %u fps\n", show.numFrames(), packets ? "packets" : "lights", header.m_frameRate);
+
+  const std::chrono::nanoseconds interval(1000000000 / header.m_frameRate);
+  const auto paceWindow = m_netMultiSender.m_pace ? std::chrono::duration_cast<std::chrono::nanoseconds>(interval * m_netMultiSender.m_paceFraction) : std::chrono::nanoseconds::zero();
+  bool ok = true;
+  const auto start = Clock::now();
+  auto due = start;
+  for(size_t n = 0; !g_quit; n++) {
+    if(n == show.numFrames()) {
+      if(!m_options.m_loop)
+	break;
+      n = 0;
+    }
+    const auto frameStart = Clock::now();
+    const std::chrono::duration<float> elapsed = frameStart - start;
+    if(m_options.m_seconds > 0.0f && elapsed.count() >= m_options.m_seconds)
+      break;
+
+    const uint8_t *frame = show.frame(n);
+    if(!frame) {
+      printf("Frame %zu of %s is corrupt\n", n, m_options.m_playFile.c_str());
+      ok = false;
+      break;
+    }
+    if(packets) {
+      m_netMultiSender.sendRecordedPackets(frame, paceWindow);
+    } else {
+      icosahedron::DequantiseLights(frame, m_lightCol);
+      m_netMultiSender.sendFrame(m_lightCol, interval);
+    }
+
+    waitForFrame(frameStart, due, interval);
+  }
+  m_elapsed = Clock::now() - start;
+
+  if(m_netMultiSender.m_enabled) {
+    m_netMultiSender.m_enabled = false;
+    m_netMultiSender.updateEnabled();
+  }
+  return ok;
+}
+
+bool HeadlessApp::render()
+{
+  const float seconds = m_options.m_seconds > 0.0f ? m_options.m_seconds : 10.0f;
+  const long numFrames = std::max(1L, std::lround(seconds * m_options.m_rate));
+
+  icosahedron::FrameFileWriter writer;
+  if(!writer.open(m_options.m_renderFile, m_lightCol.size(), m_options.m_rate))
+    return false;
+
+  m_clock.setFixedStep(1.0 / m_options.m_rate);
+  m_clock.reset();
+  const auto start = Clock::now();
+  for(long n = 0; n<numFrames && !g_quit; n++) {
+    const auto frameStart = Clock::now();
+    animateLights(m_clock.tick());
+    const auto busy = Clock::now() - frameStart;
+    m_busy += busy;
+    m_maxBusy = std::max<std::chrono::nanoseconds>(m_maxBusy, busy);
+    m_frames++;
+
+    if(!writer.write(m_lightCol))
+      break;
+  }
+  m_elapsed = Clock::now() - start;
+
+  const bool ok = writer.close() && writer.numFrames() == numFrames;
+  if(!ok)
+    printf("Failed writing %s\n", m_options.m_renderFile.c_str());
+  printf("Rendered %u frames, %.1fs of animation, in %.2fs: %.1f fps, %.1fx real time\n",
+	 writer.numFrames(), writer.numFrames() / float(m_options.m_rate), m_elapsed.count(),
+	 m_frames / m_elapsed.count(), writer.numFrames() / float(m_options.m_rate) / m_elapsed.count());
+  return ok;
+}
+
+void HeadlessApp::report() const
+{
+  if(!m_frames)
+    return;
+  printf("%ld frames in %.1fs, %.1f fps, %ld late\n", m_frames, m_elapsed.count(), m_frames / m_elapsed.count(), m_late);
+  printf("Animating and sending took %.3fms on average, %.3fms at most\n",
+	 std::chrono::duration<double, std::milli>(m_busy).count() / m_frames,
+	 std::chrono::duration<double, std::milli>(m_maxBusy).count());
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  Options options;
+  for(int n = 1; n<argc; n++) {
+    const std::string arg = argv[n];
+    auto value = [&]() -> const char * {
+      if(n + 1 >= argc) {
+	printf("%s needs a value\n", arg.c_str());
+	exit(1);
+      }
+      return argv[++n];
+    };
+    if(arg == "--pattern")
+      options.m_pattern = value();
+    else if(arg == "--list") {
+      const auto& registry = icosahedron::PatternRegistry::Instance();
+      for(int p = 0; p<registry.count(); p++)
+	printf("%i %s\n", p, registry.name(p));
+      return 0;
+    } else if(arg == "--rate")
+      options.m_rate = std::clamp(atoi(value()), 1, 1000);
+    else if(arg == "--threads")
+      options.m_threads = std::max(0, atoi(value()));
+    else if(arg == "--seconds")
+      options.m_seconds = atof(value());
+    else if(arg == "--fixed-step")
+      options.m_fixedStep = true;
+    else if(arg == "--render")
+      options.m_renderFile = value();
+    else if(arg == "--bake")
+      options.m_bake = true;
+    else if(arg == "--bake-period") {
+      options.m_bake = true;
+      options.m_bakePeriod = atof(value());
+    }
+    else if(arg == "--record")
+      options.m_recordFile = value();
+    else if(arg == "--play")
+      options.m_playFile = value();
+    else if(arg == "--loop")
+      options.m_loop = true;
+    else if(arg == "--param") {
+      const int p = atoi(value()) - 1;
+      const float v = atof(value());
+      if(p < 0 || p >= 6) {
+	printf("--param takes a parameter from 1 to 6\n");
+	return 1;
+      }
+      options.m_params[p] = std::clamp(v, 0.0f, 1.0f);
+    } else if(arg == "--inside-outside")
+      options.m_insideOutside = std::clamp(float(atof(value())), 0.0f, 1.0f);
+    else if(arg == "--edge")
+      options.m_edge = atoi(value());
+    else if(arg == "--gamma")
+      options.m_gamma = atof(value());
+    else if(arg == "--dither")
+      options.m_dither = true;
+    else if(arg == "--offset")
+      options.m_offset = atoi(value());
+    else if(arg == "--pace")
+      options.m_pace = std::clamp(float(atof(value())), 0.0f, 0.95f);
+    else if(arg == "--no-sync")
+      options.m_sync = false;
+    else if(arg == "--no-batch")
+      options.m_batch = false;
+    else if(arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+      printf("Unknown option %s\n", arg.c_str());
+      return 1;
+    } else
+      options.m_mappingFile = arg;
+  }
+
+  std::signal(SIGINT, OnSignal);
+  std::signal(SIGTERM, OnSignal);
+
+  HeadlessApp app(options);
+  if(!app.init())
+    return 1;
+  if(!options.m_renderFile.empty()) {
+    if(!app.render())
+      return 1;
+  } else if(!options.m_playFile.empty()) {
+    if(!app.play())
+      return 1;
+  } else
+    app.run();
+  app.report();
+  return 0;
+}
@@ -15,38 +15,11 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "icosahedron.hpp"
+#include "colourspace.hpp"
 
 namespace icosahedron
 {
 
-glm::vec3 HSVtoRGB(float H, float s, float v)
-{
-  float C = s*v;
-  float X = C * (1.0 - fabs(fmod(H/60.0f, 2.0f) - 1.0f));
-  float m = v-C;
-  float r,g,b;
-        
-  if(H >= 0 && H < 60) {
-    r = C, g = X, b = 0;
-  }
-  else if(H >= 60 && H < 120) {
-    r = X, g = C, b = 0;
-  }
-  else if(H >= 120 && H < 180) {
-    r = 0, g = C, b = X;
-  }
-  else if(H >= 180 && H < 240) {
-    r = 0, g = X, b = C;
-  }
-  else if(H >= 240 && H < 300) {
-    r = X, g = 0, b = C;
-  }
-  else{
-    r = C, g = 0, b = X;
-  }
-  return glm::vec3(r + m, g + m, b + m);
-}
-
 glm::vec3 RandomColour()
 {
   float H = 360.0f * (float(rand()) / (float)RAND_MAX);
@@ -360,7 +333,7 @@ void MakeIcosahedronPipesMesh(std::vector<Vertex>& verts)
   }
 }
 
-void MakeIcosahedronLightPoints(std::vector<LightPoint>& lightPos, std::vector<LightPoint>& lightCol)
+void MakeIcosahedronLightPoints(LightBuffer& lightPos, LightBuffer& lightCol, LightTopology& topology)
 {
   const auto edges = GetIcosahedronEdges();
   auto& vertices = GetIcosahedronVertices();
@@ -371,12 +344,11 @@ void MakeIcosahedronLightPoints(std::vector<LightPoint>& lightPos, std::vector<L
     return f;
   };
 
-  const auto& addLightPoint = [&lightPos, &lightCol](const auto& pos, const auto& colour) {
-    icosahedron::LightPoint pnt;
-    pnt.setPos(pos);
-    lightPos.push_back(pnt);
-    pnt.setPos(colour);
-    lightCol.push_back(pnt);
+  int edgeIdx = 0;
+  const auto& addLightPoint = [&lightPos, &lightCol, &topology, &edgeIdx](const auto& pos, const auto& colour, int side, float alongEdge) {
+    lightPos.push_back(pos);
+    lightCol.push_back(colour);
+    topology.push_back(edgeIdx, side, alongEdge);
   };
 
   const float step = 1.0f / float(edges.size());
@@ -410,328 +382,21 @@ void MakeIcosahedronLightPoints(std::vector<LightPoint>& lightPos, std::vector<L
     if(!endToEnd) {
       for(int n = 0; n<numLights; n++) {
 	float t = (float(n) * len)/float(numLights-1);
-	addLightPoint(pa + (edgeNormal * PIPE_RADIUS) + (nd * t), col);
-	addLightPoint(pa + (edgeNormal * -PIPE_RADIUS) + (nd * t), col);                        
+	addLightPoint(pa + (edgeNormal * PIPE_RADIUS) + (nd * t), col, 0, t / len);
+	addLightPoint(pa + (edgeNormal * -PIPE_RADIUS) + (nd * t), col, 1, t / len);
       }
     } else {
       for(int n = 0; n<numLights; n++) {
 	float t = (float(n) * len)/float(numLights-1);
-	addLightPoint(pa + (edgeNormal * PIPE_RADIUS) + (nd * t), col);
+	addLightPoint(pa + (edgeNormal * PIPE_RADIUS) + (nd * t), col, 0, t / len);
       }                       
       for(int n = 0; n<numLights; n++) {
 	float t = (float(n) * len)/float(numLights-1);
-	addLightPoint(pa + (edgeNormal * -PIPE_RADIUS) + (nd * t), col);
+	addLightPoint(pa + (edgeNormal * -PIPE_RADIUS) + (nd * t), col, 1, t / len);
       }
     }
+    edgeIdx++;
   }
 }
 
-// -----------------------------------------------
-// Patterns
-// -----------------------------------------------
-
-static void ClearColours(std::vector<LightPoint>& colours)
-{
-  for(auto& c : colours) {
-    c.px = 0.0f;
-    c.py = 0.0f;
-    c.pz = 0.0f;
-  }
-}
-
-static void FixedEdgesPattern(const std::vector<LightPoint>& position, std::vector<LightPoint>& colours, float t, int target)
-{
-  float step = fmod(t, 1.0f);
-  float flash = 1.0f - ((fabs(step - 0.5f)) * 2.0f);
-  int idx = target * NUM_LEDS_PER_EDGE * 2;
-  int idxLed = int(step * NUM_LEDS_PER_EDGE);
-        
-  glm::vec3 colorLed = HSVtoRGB(step * 360.f, 0.7, 1.0);
-  glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f) * flash * 0.3f;
-        
-  for(int n = 0; n<NUM_LEDS_PER_EDGE; n++) {
-    if(n == idxLed) {
-      colours[idx++].setPos(colorLed);
-      colours[idx++].setPos(colorLed);
-    } else {
-      colours[idx++].setPos(color);
-      colours[idx++].setPos(color);
-    }
-  }       
-}
-
-static void StepEdgesPattern(const std::vector<LightPoint>& position, std::vector<LightPoint>& colours, float t)
-{
-  const auto& edges = GetIcosahedronEdges();
-  int target = int(fmod(t, float(edges.size())));
-  FixedEdgesPattern(position, colours, t, target);
-}
-
-static void BasicPattern(const std::vector<LightPoint>& position, std::vector<LightPoint>& colours, float t)
-{
-  int n = 0;
-  int target = int(fmod(t * 200.0, float(colours.size())));
-  for(auto& c : colours) {
-    ++n;
-    if(n == target)
-      c.setPos(glm::vec3(1, 1, 1));
-    else
-      c.setPos(glm::vec3(0, 0, 0));
-  }
-        
-  /*
-    float step = 1.0 / float(colours.size());
-    float offset = 0.0;
-        
-    for(auto& c : colours) {
-    float h, s, v;
-    float r = fmod(t + offset, 1.0);
-    const float range = 0.1;
-    if(r < range) {
-    float j = r * (1.0 / range);
-    h = j * 360.0;
-    s = 0.5;
-    v = fabs((j - 5.0) / 5.0);
-    } else {
-    h = 0.0;
-    s = 0.0;
-    v = 0.0;
-    }
-                        
-    c.setPos(HSVtoRGB(h, s, v));
-    offset += step;
-    }
-  */                               
-}
-
-typedef std::function<float(const glm::vec3&)> HueCallback;
-
-static void BaseRingPattern(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, const glm::mat4& xform, HueCallback func)
-{       
-  float range = 0.2;
-  for(int n = 0; n<positions.size(); n++) {
-    glm::vec4 pos = glm::vec4(positions[n].px, positions[n].py, positions[n].pz, 1.0);
-    pos = xform * pos; 
-    auto& col = colours[n];
-
-    float d = fabs(pos.x);
-    if(d < range) {
-      float v = 1.0 - (d / range);
-      v *= 1.3;
-      v = v* v * v * v;
-      glm::vec3 c = HSVtoRGB(func(pos), 0.7, v);
-      col.px += c.x;
-      col.py += c.y;
-      col.pz += c.z;                  
-    }
-  }
-}
-
-static void RingPattern1(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time)
-{
-  glm::mat4 xform = glm::rotate(glm::mat4(1.0), time * 3.0f, glm::vec3(0.0, 1.0, 0.0));
-  xform = glm::rotate(xform, time * 2.0f, glm::vec3(1.0, 0.0, 0.0));
-  xform = glm::rotate(xform, time * 0.5f, glm::vec3(0.0, 0.0, 1.0));            
-  BaseRingPattern(positions, colours, xform, [time](const glm::vec3& pos) { return fmod(time * 100.0, 360.0f); });
-}
-
-static void RingPatternManual(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time, float *params, int nParams)
-{
-  glm::mat4 xform = glm::rotate(glm::mat4(1.0), float(params[0] * M_PI), glm::vec3(0.0, 1.0, 0.0));
-  xform = glm::rotate(xform, float(params[1] * M_PI), glm::vec3(1.0, 0.0, 0.0));
-  xform = glm::rotate(xform, float(params[2] * M_PI), glm::vec3(0.0, 0.0, 1.0));                
-  BaseRingPattern(positions, colours, xform, [params](const glm::vec3& pos) { return params[3] * 360.0; });
-}
-
-static void RingPattern2(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time)
-{
-  glm::mat4 xform = glm::rotate(glm::mat4(1.0), time * 2.0f, glm::vec3(0.0, 1.0, 0.0));
-
-  BaseRingPattern(positions, colours, xform,
-		  [time](const glm::vec3& pos) {
-		    float h = ((atan2(pos.z, pos.y) / glm::pi<float>()) * 180.0) + (time * 100.0);
-		    h = fmod(h, 360.0);                     
-		    return h;
-		  });
-}
-
-static void MultiRingPattern(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time)
-{
-  // because we are accumulating this value every frame then this number is senstive.
-  const float sf = 0.11;
-
-  const float fixedFactor = 0.01;
-  static float rx = 0.0;
-  rx += glm::perlin(glm::vec2(time * 0.1f, 0.0)) * 0.11;
-  if(rx > 0.0)
-    rx += fixedFactor;
-  else
-    rx -= fixedFactor;
-                         
-        
-  static float ry = 0.0;
-  ry += glm::perlin(glm::vec2(time * 0.1f, 10.0)) * 0.11;
-  if(ry > 0.0)
-    ry += fixedFactor;
-  else
-    ry -= fixedFactor;     
-
-  static float rz = 0.0;
-  rz += glm::perlin(glm::vec2(time * 0.1f, 20.0)) * 0.11;
-  if(rz > 0.0)
-    rz += fixedFactor;
-  else
-    rz -= fixedFactor;     
-        
-  glm::mat4 xformA = glm::rotate(glm::mat4(1.0), rx, glm::vec3(0.0, 0.0, 1.0));
-  glm::mat4 xformB = glm::rotate(glm::mat4(1.0), ry, glm::vec3(0.0, 1.0, 0.0));
-  glm::mat4 xformC = glm::rotate(glm::mat4(1.0), rz, glm::vec3(1.0, 0.0, 0.0));         
-        
-  BaseRingPattern(positions, colours, xformA, [time](const glm::vec3& pos) { return 1.0;/*fmod(time * 36.0, 360.0f);*/ });
-  BaseRingPattern(positions, colours, xformA * xformB, [time](const glm::vec3& pos) { return 90.0;/*fmod(time * 36.0, 360.0f);*/ });
-  BaseRingPattern(positions, colours, xformA * xformB * xformC, [time](const glm::vec3& pos) { return 180.0;/*fmod(time * 36.0, 360.0f);*/ });
-
-}
-
-static void SweepPattern(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time, float *params, int nParams)
-{
-  float h = fmod(time * 0.2, 1.0) * 360.0;
-        
-  const float sweep = 2.0;
-  glm::mat4 xform = glm::translate(glm::mat4(1.0f), glm::vec3(fmod(time * 3.0, sweep * 2.0f) - sweep, 0, 0));
-
-  xform = glm::rotate(xform, float(params[0] * M_PI), glm::vec3(0.0, 1.0, 0.0));
-  xform = glm::rotate(xform, float(params[1] * M_PI), glm::vec3(1.0, 0.0, 0.0));
-  xform = glm::rotate(xform, float(params[2] * M_PI), glm::vec3(0.0, 0.0, 1.0));
-        
-  float range = 0.4;
-  for(int n = 0; n<positions.size(); n++) {
-    glm::vec4 pos = glm::vec4(positions[n].px, positions[n].py, positions[n].pz, 1.0);
-    pos = xform * pos;
-    auto& col = colours[n];
-
-    float t = fabs(pos.x);
-    if(t < range) {
-      float v = pow(1.0f - (t / range), 1.0f / params[3]);
-      col.setPos(HSVtoRGB(h, v, v));
-    }
-  }
-}
-
-static void InsideOutPattern(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time, float *params, int nParams, WhichSideCallback whichSide)
-{
-  float mix = fabs(fmod(time * 3.0f * params[0], 2.0f) - 1.0f);
-  float sideMix[2] = {(mix * 2.0f), (1.0f - mix) * 2.0f}; 
-  float h = fmod(time * 0.2, 1.0) * 360.0;
-        
-  for(int n = 0; n<positions.size(); n++) {
-    auto& col = colours[n];                 
-    float v = 1.0;
-    col.setPos(HSVtoRGB(h, v, v));          
-    int side = whichSide(n);//(n / NUM_LEDS_PER_EDGE) & 1;
-    const float sm = sideMix[side];
-    col.px *= sm;
-    col.py *= sm;
-    col.pz *= sm;                   
-  }               
-}
-
-static void PlasmaPattern(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time, float *params, int nParams)
-{
-  for(int n = 0; n<positions.size(); n++) {
-    auto& col = colours[n];
-    auto& pos = positions[n];                                               
-    float h = (glm::perlin(glm::vec3(pos.px * 10.0, pos.pz * 10.0, time * params[0] * 10.0f)) + 1.0f) * 0.5f;
-    float v = params[1];
-    col.setPos(HSVtoRGB(h * 360.f, params[1], params[2]));
-  }
-}
-
-static void SpecklyPlasmaPattern(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time, float *params, int nParams)
-{
-  for(int n = 0; n<positions.size(); n++) {
-    auto& col = colours[n];
-    auto& pos = positions[n];                                               
-    float h = (glm::perlin(glm::vec3(pos.px * 10.0, pos.pz * 10.0, time * params[0] * 10.0f)) + 1.0f) * 0.5f;
-    float v = (glm::perlin(glm::vec3(pos.px * 10.0, pos.pz * 10.0, time * params[2] * 10.0f)) + 1.0f) * 0.5f;
-    v = pow(v, 1.0f / params[3]);
-    col.setPos(HSVtoRGB(h * 360.f, params[1], v));
-  }
-}
-
-static void MixInsideOutside(const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float mix, WhichSideCallback whichSide)
-{
-  float sideMix[2] = {(mix * 2.0f), (1.0f - mix) * 2.0f};
-  for(int n = 0; n<positions.size(); n++) {
-    int side = whichSide(n);//(n / NUM_LEDS_PER_EDGE) & 1;
-    auto& col = colours[n];
-    const float sm = sideMix[side];
-    col.px *= sm;
-    col.py *= sm;
-    col.pz *= sm;                   
-  }
-}
-
-const char* g_animationNames[] = {
-  "Moving Dot",
-  "Moving Edges",
-  "Highlight Edge",
-  "Manual Control Ring",
-  "Ring1",
-  "Ring2",
-  "Sweep",
-  "Multi Ring",
-  "Inside Out",
-  "Plasma",
-  "Speckly Plasma"
-};
-
-int GetNumAnimationPatterns()
-{
-  return 11;
-}
-
-void AnimateLightColours(int pattern, const std::vector<LightPoint>& positions, std::vector<LightPoint>& colours, float time, int arg, float *params, int nParams, float insideOutsideMix, WhichSideCallback whichSide)
-{
-  ClearColours(colours);
-  switch(pattern) {
-  case 0:
-    BasicPattern(positions, colours, time);
-    break;
-  case 1:
-    StepEdgesPattern(positions, colours, time);
-    break;
-  case 2:
-    FixedEdgesPattern(positions, colours, time, arg-1);
-    break;
-  case 3:
-    RingPatternManual(positions, colours, time, params, nParams);
-    break;
-  case 4:
-    RingPattern1(positions, colours, time);
-    break;
-  case 5:
-    RingPattern2(positions, colours, time);
-    break;          
-  case 6:
-    SweepPattern(positions, colours, time, params, nParams);
-    break;
-  case 7:
-    MultiRingPattern(positions, colours, time);
-    break;
-  case 8:
-    InsideOutPattern(positions, colours, time, params, nParams, whichSide);
-    break;
-  case 9:
-    PlasmaPattern(positions, colours, time, params, nParams);
-    break;
-  case 10:
-    SpecklyPlasmaPattern(positions, colours, time, params, nParams);
-    break;          
-  }
-
-  MixInsideOutside(positions, colours, insideOutsideMix, whichSide);
-        
-}
-
 }
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+namespace icosahedron {
+
+/// Alignment of every plane in a LightBuffer, a cache line which is also enough for AVX-512 loads.
+const size_t LIGHT_BUFFER_ALIGNMENT = 64;
+
+/// Planes are padded with zeros up to a multiple of this many lights so SIMD loops never need
+/// a scalar tail.
+const size_t LIGHT_BUFFER_PADDING = 16;
+
+/// std::vector allocator that returns memory aligned to Alignment bytes.
+template<typename T, size_t Alignment = LIGHT_BUFFER_ALIGNMENT> struct AlignedAllocator {
+  typedef T value_type;
+  template<typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+  AlignedAllocator() = default;
+  template<typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T *p, size_t) {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template<typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+  template<typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloatVector;
+
+/// Half open range [m_begin, m_end) of light indices to work on.
+struct LightRange {
+  int m_begin = 0;
+  int m_end = 0;
+
+  int size() const { return m_end - m_begin; }
+};
+
+/// Structure of arrays storage for a set of lights. Each of the three planes is a separate
+/// aligned array of floats; they hold x/y/z for positions and r/g/b for colours. Keeping the
+/// channels apart lets the per-light loops of the patterns and the packers vectorise.
+class LightBuffer {
+public:
+  LightBuffer() {}
+  explicit LightBuffer(size_t count) { resize(count); }
+
+  /// Number of lights, the planes may be longer than this because of padding.
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  /// Number of floats in each plane including the zero padding.
+  size_t paddedSize() const { return m_plane[0].size(); }
+
+  void resize(size_t count) {
+    m_size = count;
+    size_t padded = ((count + LIGHT_BUFFER_PADDING - 1) / LIGHT_BUFFER_PADDING) * LIGHT_BUFFER_PADDING;
+    for(auto& p : m_plane) {
+      p.resize(padded, 0.0f);
+      // shrinking within the same padding leaves the old values behind the new end.
+      std::fill(p.begin() + count, p.end(), 0.0f);
+    }
+  }
+
+  void clear() { m_size = 0; for(auto& p : m_plane) p.clear(); }
+
+  void push_back(const glm::vec3& v) {
+    size_t n = m_size;
+    if(n >= paddedSize())
+      resize(n + 1);
+    else
+      m_size = n + 1;
+    set(n, v);
+  }
+
+  float *plane(int c) { return m_plane[c].data(); }
+  const float *plane(int c) const { return m_plane[c].data(); }
+
+  float *x() { return plane(0); }
+  float *y() { return plane(1); }
+  float *z() { return plane(2); }
+  const float *x() const { return plane(0); }
+  const float *y() const { return plane(1); }
+  const float *z() const { return plane(2); }
+
+  float *r() { return plane(0); }
+  float *g() { return plane(1); }
+  float *b() { return plane(2); }
+  const float *r() const { return plane(0); }
+  const float *g() const { return plane(1); }
+  const float *b() const { return plane(2); }
+
+  void set(size_t idx, const glm::vec3& v) {
+    m_plane[0][idx] = v.x;
+    m_plane[1][idx] = v.y;
+    m_plane[2][idx] = v.z;
+  }
+
+  void add(size_t idx, const glm::vec3& v) {
+    m_plane[0][idx] += v.x;
+    m_plane[1][idx] += v.y;
+    m_plane[2][idx] += v.z;
+  }
+
+  glm::vec3 get(size_t idx) const {
+    return glm::vec3(m_plane[0][idx], m_plane[1][idx], m_plane[2][idx]);
+  }
+
+private:
+  size_t m_size = 0;
+  AlignedFloatVector m_plane[3];
+};
+
+}
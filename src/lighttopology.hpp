@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace icosahedron {
+
+/// Where each light is on the rig, one entry per light in the same order as the LightBuffers.
+/// Worked out when the lights are made and again when a mapping file is loaded so that the
+/// patterns can just look things up by light index.
+struct LightTopology {
+  /// Which of the two strings along an edge the light is on as built, 0 outside and 1 inside.
+  std::vector<uint8_t> m_side;
+  /// The side with the strings that the mapping file sends reversed swapped over, which is how
+  /// the real rig is wired.
+  std::vector<uint8_t> m_mappedSide;
+  /// Index of the edge, in GetIcosahedronEdges() order.
+  std::vector<uint16_t> m_edge;
+  /// Position along the edge, 0 at its first vertex and 1 at the second.
+  std::vector<float> m_alongEdge;
+  /// Index of the host in the mapping file that drives the light, -1 when none does.
+  std::vector<int16_t> m_host;
+  /// Is 1 when the mapping file sends the light's string reversed.
+  std::vector<uint8_t> m_reversed;
+
+  int size() const { return m_side.size(); }
+
+  void clear() {
+    for(auto *v : {&m_side, &m_mappedSide, &m_reversed})
+      v->clear();
+    m_edge.clear();
+    m_alongEdge.clear();
+    m_host.clear();
+  }
+
+  /// Adds a light that isn't in any mapping yet.
+  void push_back(int edge, int side, float alongEdge) {
+    m_side.push_back(side);
+    m_mappedSide.push_back(side);
+    m_edge.push_back(edge);
+    m_alongEdge.push_back(alongEdge);
+    m_host.push_back(-1);
+    m_reversed.push_back(0);
+  }
+
+  /// Forgets any mapping file.
+  void clearMapping() {
+    m_mappedSide = m_side;
+    m_host.assign(size(), -1);
+    m_reversed.assign(size(), 0);
+  }
+
+  /// Records that the light at idx is sent to host, unless an earlier range already claimed it.
+  void setMapping(int idx, int host, bool reversed) {
+    if(m_host[idx] >= 0)
+      return;
+    m_host[idx] = host;
+    m_reversed[idx] = reversed;
+    m_mappedSide[idx] = m_side[idx] ^ uint8_t(reversed);
+  }
+};
+
+}
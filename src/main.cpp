@@ -11,6 +11,7 @@
 #include <functional>
 #include <memory>
 #include <list>
+#include <cmath>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
@@ -30,8 +31,15 @@
 #include <imgui_impl_opengl3.h>
 
 #include "icosahedron.hpp"
+#include "animationclock.hpp"
+#include "bakecache.hpp"
+#include "patterns.hpp"
+#include "threadpool.hpp"
+#include "outputthread.hpp"
+#include "spatialgrid.hpp"
 #include "vertexdesc.hpp"
 #include "glhelpers.hpp"
+#include "colourcorrection.hpp"
 #include "network.hpp"
 #include "serial.hpp"
 #include "controlpacket.hpp"
@@ -82,7 +90,7 @@ public:
   /// Switches the app between fullscreen and windowed mode.
   void toggleFullscreen();
 
-  /// Animates the lights colours and uploads them to the GPU
+  /// Animates the lights colours, uploads them to the GPU and sends them to the rig.
   void animateLights();
 
   /// Draw the GUI with ImGUI - because ImGUI is an immediate mode GUI then drawing is also where
@@ -92,6 +100,9 @@ public:
   /// Handles the serial connection to the mixer hardware.
   void handleSerial();
 
+  /// Starts or stops sending from the output thread to match m_outputThreadEnabled.
+  void updateOutputThread();
+
 private:
   /// The app is a singleton, get the only instance using Instance().
   NiceLightsApp() :
@@ -129,6 +140,28 @@ private:
   /// The index number of the animation to use.
   int m_animation;
 
+  /// One instance of every registered pattern, indexed by m_animation. Each keeps its own state
+  /// so switching between them carries on where they left off.
+  std::vector<std::unique_ptr<icosahedron::Pattern>> m_patterns;
+
+  /// Threads that the patterns are evaluated on.
+  icosahedron::ThreadPool m_threadPool;
+
+  /// Time that the patterns are animated at, real time from when the lights were made.
+  icosahedron::AnimationClock m_clock;
+
+  /// Replays the patterns that loop from memory rather than evaluating them every frame.
+  icosahedron::BakeCache m_bakeCache;
+
+  /// Is true if the looping patterns are baked into m_bakeCache.
+  bool m_bakeLoops = false;
+
+  /// Loop period to bake instead of the pattern's own, 0 uses the pattern's.
+  float m_bakePeriod = 0.0f;
+
+  /// Number of threads in m_threadPool, as edited in the GUI.
+  int m_animationThreads = m_threadPool.threadCount();
+
   /// The index number of an edge to highlight when using the highlight mode to debug the mapping file.
   int m_edge;
 
@@ -171,13 +204,23 @@ private:
   GLuint m_progLightPoints;
 
   /// Colours of the all lights
-  std::vector<icosahedron::LightPoint> m_lightCol;
+  icosahedron::LightBuffer m_lightCol;
 
   /// Positions of the all lights  
-  std::vector<icosahedron::LightPoint> m_lightPos;
+  icosahedron::LightBuffer m_lightPos;
+
+  /// Which edge, side and host each light belongs to.
+  icosahedron::LightTopology m_lightTopology;
+
+  /// Index of m_lightPos for the patterns that only light part of the rig.
+  icosahedron::SpatialGrid m_lightGrid;
+
+  /// Is true if the senders pack each chunk of lights straight after the pattern has evaluated it,
+  /// rather than going over all the lights again afterwards.
+  bool m_fusedOutput = true;
 
-  /// GL buffer if of the light colour buffer array.
-  GLuint m_lightColBuffer;
+  /// GL buffer ids of the red, green and blue light colour buffer arrays.
+  GLuint m_lightColBuffers[3];
 
   /// E131 transmitter with support for mapping between local lights and the remote edges and microcontrollers.
   NetworkMultiSender m_netMultiSender;
@@ -188,6 +231,16 @@ private:
   /// E131 receiver without mapping - can receive from the sender above.
   NetworkReceiver m_netReceiver;
 
+  /// Sends the lights to the rig at a fixed rate from its own thread, rather than from
+  /// animateLights() at the display's refresh rate divided by the framerate divisors.
+  icosahedron::OutputThread m_outputThread;
+
+  /// Is true if the senders are driven by m_outputThread.
+  bool m_outputThreadEnabled = false;
+
+  /// Frames per second that m_outputThread sends.
+  int m_outputRate = 50;
+
   /// Parameters from the mixers passed to the current light animation
   float m_animParams[6];
 
@@ -219,6 +272,11 @@ private:
   /// continually increments in the data from the mixer and is used to track whether frames are being dropped.
   int m_serialSeqNum = 0;
 
+  /// Show file that the rig's packets are recorded into, and whether it's being recorded. This is
+  /// kept here rather than asking the sender so the GUI doesn't wait on the output thread.
+  char m_showFile[256] = "show.nlshow";
+  bool m_recordShow = false;
+
 #ifdef _WIN32
   char m_serialDev[128] = "COM1";
 #else
@@ -328,8 +386,12 @@ void main(void)
 
 const char *g_vertShaderLightPoints = R"_X_(
 #version 420
-layout (location = 0) in vec3 pos;
-layout (location = 1) in vec3 col;
+layout (location = 0) in float posX;
+layout (location = 1) in float posY;
+layout (location = 2) in float posZ;
+layout (location = 3) in float colR;
+layout (location = 4) in float colG;
+layout (location = 5) in float colB;
 
 out vec4 vs_col;
 out vec4 vs_centre;
@@ -353,6 +415,7 @@ const vec4 offsets[6] = {
 void main(void)
 {
   int iVert = gl_VertexID % 6;
+  vec3 pos = vec3(posX, posY, posZ);
 
   gl_Position = modelViewMat * vec4(pos, 1.0);
   gl_Position += offsets[iVert] * 0.05;
@@ -360,7 +423,7 @@ void main(void)
   gl_Position = projMat * gl_Position;
 
   vs_centre = modelViewMat * vec4(pos, 1.0);
-  vs_col = vec4(col, 1.0);
+  vs_col = vec4(colR, colG, colB, 1.0);
 }
 
 )_X_";
@@ -373,43 +436,59 @@ void NiceLightsApp::initLightPoints()
   };  
   m_progLightPoints = ShaderDesc::CreateShaderProgram(shadersLightPoints);
 
-  icosahedron::MakeIcosahedronLightPoints(m_lightPos, m_lightCol);
+  icosahedron::MakeIcosahedronLightPoints(m_lightPos, m_lightCol, m_lightTopology);
+  m_lightGrid.build(m_lightPos);
   
   m_countLightsPoints = m_lightPos.size();
   printf("Light Point count %lu\n", m_countLightsPoints);
   
-  const auto lpSize = sizeof(icosahedron::LightPoint);
-  size_t vertexDataSize = m_countLightsPoints * lpSize;
+  // the light buffers are structure of arrays, so each channel is its own single float attribute.
+  size_t vertexDataSize = m_countLightsPoints * sizeof(float);
 
   std::vector<VertexDesc> vertexDescArray;
   
   VertexDesc v;
-  v.m_attrib = glGetAttribLocation(m_progLightPoints, "pos");
   v.m_offset = 0;
   v.m_type = GL_FLOAT;
-  v.m_count = 3;
+  v.m_count = 1;
   v.m_divisor = 1;
-  v.m_stride = lpSize;
-  v.m_vertexData = &m_lightPos[0].px;
+  v.m_stride = sizeof(float);
   v.m_vertexDataSize = vertexDataSize;
-  vertexDescArray.push_back(v);
 
-  v.m_attrib = glGetAttribLocation(m_progLightPoints, "col");
-  v.m_vertexData = &m_lightCol[0].px;
-  vertexDescArray.push_back(v);
+  static const char *posAttribs[3] = {"posX", "posY", "posZ"};
+  static const char *colAttribs[3] = {"colR", "colG", "colB"};
+  for(int c = 0; c<3; c++) {
+    v.m_attrib = glGetAttribLocation(m_progLightPoints, posAttribs[c]);
+    v.m_vertexData = m_lightPos.plane(c);
+    vertexDescArray.push_back(v);
+  }
+  for(int c = 0; c<3; c++) {
+    v.m_attrib = glGetAttribLocation(m_progLightPoints, colAttribs[c]);
+    v.m_vertexData = m_lightCol.plane(c);
+    vertexDescArray.push_back(v);
+  }
 
   m_vaoLightPoints = VertexDesc::CreateArrayOfArraysVAO(vertexDescArray);
 
-  m_lightColBuffer = vertexDescArray[1].m_bufferID;
-  assert(m_lightColBuffer >= 0);
+  for(int c = 0; c<3; c++) {
+    m_lightColBuffers[c] = vertexDescArray[3 + c].m_bufferID;
+    assert(m_lightColBuffers[c] > 0);
+  }
 
   m_netSender.initPackets(m_lightCol.size());
   m_netReceiver.init(m_lightCol.size());  
+
+  const auto& registry = icosahedron::PatternRegistry::Instance();
+  for(int n = 0; n<registry.count(); n++)
+    m_patterns.push_back(registry.create(n));
+  m_clock.reset();
+  // the display's refresh rate, which is how often the GUI animates.
+  m_bakeCache.setFrameRate(60);
 }
 
 void NiceLightsApp::animateLights()
 {
-  float t = SDL_GetTicks() / 1000.0;
+  float t = m_clock.tick();
 
   if(m_applyPeripheralData) {
     m_animation = m_bankData[m_bankSelect].m_pot;           
@@ -422,8 +501,11 @@ void NiceLightsApp::animateLights()
     m_insideOutsideAnimateSpeed = m_faders[2];
   }
         
+  // set when the senders have packed the frame as it was animated.
+  bool sent = false;
+
   if(m_netReceiver.m_enabled)
-    m_netReceiver.update(&m_lightCol[0], m_lightCol.size());
+    m_netReceiver.update(m_lightCol);
   else {
     float insideMix = m_insideOutside;
     if(m_insideOutsideAnimateSpeed > 0.0) {
@@ -436,27 +518,73 @@ void NiceLightsApp::animateLights()
 	insideMix = 0.0f;
     }
                 
-    icosahedron::WhichSideCallback whichSide = [this](int n) -> int {
-      if(m_netMultiSender.m_enabled)
-	return m_netMultiSender.whichSide(n);
-      else
-	return (n / icosahedron::NUM_LEDS_PER_EDGE) & 1;
-    };
-                
-    icosahedron::AnimateLightColours(m_animation,
-				     m_lightPos,
-				     m_lightCol,
-				     t,
-				     m_edge,
-				     m_animParams,
-				     sizeof(m_animParams)/sizeof(m_animParams[0]),
-				     insideMix,
-				     whichSide);
-                                                 
+    icosahedron::PatternFrame frame;
+    frame.m_time = t;
+    frame.m_arg = m_edge;
+    frame.m_params = m_animParams;
+    frame.m_nParams = sizeof(m_animParams)/sizeof(m_animParams[0]);
+    frame.m_insideOutsideMix = insideMix;
+    frame.m_topology = &m_lightTopology;
+    frame.m_useMappedSides = m_netMultiSender.m_enabled;
+    frame.m_grid = &m_lightGrid;
+
+    if(m_bakeLoops && m_bakeCache.lookup(m_animation, *m_patterns[m_animation], frame, m_lightPos, m_lightCol)) {
+      // replayed from the baked loop, the senders pack it as a whole frame below.
+    } else if(m_fusedOutput && !m_outputThreadEnabled) {
+      const bool sendBasic = m_netSender.beginFrame();
+      const bool sendRig = m_netMultiSender.beginFrame();
+      icosahedron::AnimateLightColours(*m_patterns[m_animation],
+				       m_lightPos,
+				       m_lightCol,
+				       frame,
+				       m_threadPool,
+				       [&](const icosahedron::LightBuffer& colours, icosahedron::LightRange range) {
+					 if(sendBasic)
+					   m_netSender.packLights(colours, range);
+					 if(sendRig)
+					   m_netMultiSender.packLights(colours, range);
+				       });
+      if(sendBasic)
+	m_netSender.sendPackets();
+      if(sendRig)
+	m_netMultiSender.sendPackets();
+      sent = true;
+    } else {
+      icosahedron::AnimateLightColours(*m_patterns[m_animation],
+				       m_lightPos,
+				       m_lightCol,
+				       frame,
+				       m_threadPool);
+    }
   }
         
-  glNamedBufferSubData(m_lightColBuffer, 0, sizeof(icosahedron::LightPoint) * m_lightCol.size(), &m_lightCol[0].px);
-  GL_CHECK_ERROR();
+  for(int c = 0; c<3; c++) {
+    glNamedBufferSubData(m_lightColBuffers[c], 0, sizeof(float) * m_lightCol.size(), m_lightCol.plane(c));
+    GL_CHECK_ERROR();
+  }
+
+  if(m_outputThreadEnabled) {
+    auto& frames = m_outputThread.frames();
+    frames.writeBuffer() = m_lightCol;
+    frames.publish();
+  } else if(!sent) {
+    m_netSender.update(m_lightCol);
+    m_netMultiSender.update(m_lightCol);
+  }
+}
+
+void NiceLightsApp::updateOutputThread()
+{
+  if(!m_outputThreadEnabled) {
+    m_outputThread.stop();
+    return;
+  }
+
+  m_outputThread.start(m_outputRate, [this](const icosahedron::LightBuffer& lights) {
+    if(m_netSender.m_enabled)
+      m_netSender.sendFrame(lights);
+    m_netMultiSender.sendFrame(lights, std::chrono::nanoseconds(1000000000 / m_outputThread.rate()));
+  });
 }
 
 void NiceLightsApp::initMesh()
@@ -535,8 +663,21 @@ void NiceLightsApp::drawGUI()
   ImGui::Checkbox("Draw Support Frame", &m_drawFrame);
   ImGui::SliderFloat("Camera Distance", &m_camDistance, 0.1f, 10.0f);
         
-  ImGui::Combo("Style", &m_animation, icosahedron::g_animationNames, icosahedron::GetNumAnimationPatterns());
+  const auto& patterns = icosahedron::PatternRegistry::Instance();
+  ImGui::Combo("Style", &m_animation, patterns.names(), patterns.count());
+  if(ImGui::SliderInt("Animation Threads", &m_animationThreads, 1, std::max(1u, std::thread::hardware_concurrency())))
+    m_threadPool.setThreadCount(m_animationThreads);
   ImGui::SliderInt("Highlight", &m_edge, 1, 30);
+  if(ImGui::Checkbox("Bake Loops", &m_bakeLoops) && !m_bakeLoops)
+    m_bakeCache.invalidate();
+  if(ImGui::SliderFloat("Bake Period", &m_bakePeriod, 0.0f, 60.0f))
+    m_bakeCache.setPeriod(m_bakePeriod);
+  if(m_bakeLoops) {
+    if(m_bakeCache.baking())
+      ImGui::Text("Baking");
+    else if(m_bakeCache.period() > 0.0f)
+      ImGui::Text("%.1fs loop baked, %.1f MB", m_bakeCache.period(), m_bakeCache.bytes() / (1024.0f * 1024.0f));
+  }
         
   ImGui::SeparatorText("Generic Animation");
   ImGui::SliderFloat("Anim Param 1", &m_animParams[0], 0.0, 1.0);
@@ -546,37 +687,83 @@ void NiceLightsApp::drawGUI()
   ImGui::SliderFloat("Inside/Outside Mix", &m_insideOutside, 0.0, 1.0);
   ImGui::SliderFloat("Inside/Outside Mod", &m_insideOutsideAnimateSpeed, 0.0, 1.0);       
         
+  // the output thread holds the senders' lock for the whole of each send, which with pacing is
+  // most of the frame, so the widgets edit a copy and the lock is only taken to store a change.
+  const auto senderSetting = [this](auto& setting, const auto& widget, const std::function<void()>& onChange = nullptr) {
+    auto value = setting;
+    if(!widget(value))
+      return;
+    auto senderLock = m_outputThread.lockSenders();
+    setting = value;
+    if(onChange)
+      onChange();
+  };
+
   ImGui::SeparatorText("E131 Basic");                             
   if(ImGui::Checkbox("Receive", &m_netReceiver.m_enabled))
     m_netReceiver.updateEnabled();
 
   ImGui::Checkbox("Receiver Dont Wait", &m_netReceiver.m_dontWaitForAllUniverses);
+  ImGui::SliderInt("Receiver Jitter Frames", &m_netReceiver.m_jitterFrames, 0, 4);
+  if(m_netReceiver.m_enabled) {
+    const auto& stats = m_netReceiver.stats();
+    ImGui::Text("Sources %i, late %i, lost %i, duplicate %i", m_netReceiver.getNumSources(), stats.m_late, stats.m_lost, stats.m_duplicate);
+  }
         
+  // only read when the sender is enabled, which takes the lock.
   ImGui::InputText("Destination", m_netSender.m_ipAddress, sizeof(m_netSender.m_ipAddress)-1);
 
-  if(ImGui::Checkbox("Transit", &m_netSender.m_enabled))
-    m_netSender.updateEnabled();
-
-  if(ImGui::SliderInt("Framerate divisor", &m_netSender.m_divisor, 1, 30))
-    m_netSender.updateDivisor();
-        
-  ImGui::SliderInt("Max Universe", &m_netSender.m_maxUniverse, 1, m_netSender.getNumUniverses());
+  senderSetting(m_netSender.m_enabled, [](bool& v) { return ImGui::Checkbox("Transit", &v); },
+		[this]() { m_netSender.updateEnabled(); });
+  senderSetting(m_netSender.m_divisor, [](int& v) { return ImGui::SliderInt("Framerate divisor", &v, 1, 30); },
+		[this]() { m_netSender.updateDivisor(); });
+  senderSetting(m_netSender.m_maxUniverse, [this](int& v) { return ImGui::SliderInt("Max Universe", &v, 1, m_netSender.getNumUniverses()); });
         
   ImGui::SeparatorText("E131 Rig");                               
         
-  if(ImGui::Button("Read Mapping File")) {
-    m_netMultiSender.readRangesFile("./src/edge-map.txt");
+  const char *mappingFile = nullptr;
+  if(ImGui::Button("Read Mapping File"))
+    mappingFile = "./src/edge-map.txt";
+  if(ImGui::Button("Read Local Mapping File"))
+    mappingFile = "./src/edge-map-local.txt";
+  if(mappingFile) {
+    auto senderLock = m_outputThread.lockSenders();
+    m_netMultiSender.readRangesFile(mappingFile);
+    m_netMultiSender.updateTopology(m_lightTopology);
+    m_bakeCache.invalidate();
+    // reading the mapping stops the recording.
+    m_recordShow = false;
   }
-  if(ImGui::Button("Read Local Mapping File")) {
-    m_netMultiSender.readRangesFile("./src/edge-map-local.txt");
-  }       
 
-  if(ImGui::Checkbox("Transmit", &m_netMultiSender.m_enabled))
-    m_netMultiSender.updateEnabled();
+  senderSetting(m_netMultiSender.m_enabled, [](bool& v) { return ImGui::Checkbox("Transmit", &v); },
+		[this]() { m_netMultiSender.updateEnabled(); });
+  senderSetting(m_netMultiSender.m_frameDivisor, [](int& v) { return ImGui::SliderInt("Framerate divisor", &v, 1, 30); });
+  ImGui::Checkbox("Fused Output", &m_fusedOutput);
+  senderSetting(m_netMultiSender.m_batchSend, [](bool& v) { return ImGui::Checkbox("Batched Send", &v); });
+  senderSetting(m_netMultiSender.m_sync, [](bool& v) { return ImGui::Checkbox("Universe Sync", &v); });
+  senderSetting(m_netMultiSender.m_pace, [](bool& v) { return ImGui::Checkbox("Paced Send", &v); });
+  senderSetting(m_netMultiSender.m_paceFraction, [](float& v) { return ImGui::SliderFloat("Pacing Window", &v, 0.05, 0.95); });
+  senderSetting(m_netMultiSender.m_gamma, [](float& v) { return ImGui::SliderFloat("Gamma", &v, 0.1, 5.0); });
+  senderSetting(m_netMultiSender.m_dither, [](bool& v) { return ImGui::Checkbox("Temporal Dithering", &v); });
+  senderSetting(m_netMultiSender.m_packetStartOffset, [](int& v) { return ImGui::SliderInt("Packet Offset", &v, 0, 4); });
+  ImGui::InputText("Show File", m_showFile, sizeof(m_showFile)-1);
+  if(ImGui::Checkbox("Record Show", &m_recordShow)) {
+    auto senderLock = m_outputThread.lockSenders();
+    if(m_recordShow) {
+      // the rate the packets are actually sent at, which the show is played back at.
+      const int rate = m_outputThreadEnabled ? m_outputRate : std::max(1, int(std::lround(ImGui::GetIO().Framerate / m_netMultiSender.m_frameDivisor)));
+      m_recordShow = m_netMultiSender.startRecording(m_showFile, rate);
+    } else
+      m_netMultiSender.stopRecording();
+  }
 
-  ImGui::SliderInt("Framerate divisor", &m_netMultiSender.m_frameDivisor, 1, 30);
-  ImGui::SliderFloat("Gamma", &GammaCorrection::g_gammaCorrection, 0.1, 5.0);
-  ImGui::SliderInt("Packet Offset", &m_netMultiSender.m_packetStartOffset, 0, 4);                 
+  ImGui::SeparatorText("Output");
+  if(ImGui::Checkbox("Output Thread", &m_outputThreadEnabled))
+    updateOutputThread();
+  if(ImGui::SliderInt("Output Rate", &m_outputRate, 1, 120))
+    m_outputThread.setRate(m_outputRate);
+  if(m_outputThreadEnabled)
+    ImGui::Text("%.1f Hz sent", m_outputThread.measuredRate());
 
   ImGui::End();
 
@@ -606,7 +793,7 @@ void NiceLightsApp::drawGUI()
     static const char *potName[3] = {"Pot A (pattern)", "Pot B (pattern)", "Pot C (pattern)"};              
     ImGui::SeparatorText(bankName[n]);              
     ImGui::SliderInt(switchName[n], &m_bankData[n].m_switch, 0, 2);
-    ImGui::SliderInt(potName[n], &m_bankData[n].m_pot, 0, icosahedron::GetNumAnimationPatterns()-1);
+    ImGui::SliderInt(potName[n], &m_bankData[n].m_pot, 0, icosahedron::PatternRegistry::Instance().count()-1);
   }
         
   ImGui::SeparatorText("Sliders");                
@@ -644,10 +831,6 @@ void NiceLightsApp::drawGL()
 
   animateLights();
 
-  unsigned int ledCount = m_lightCol.size();
-  const icosahedron::LightPoint *lightPtr = &m_lightCol[0];
-  m_netSender.update(lightPtr, ledCount);
-  m_netMultiSender.update(lightPtr, ledCount);
   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
   if(m_drawFrame) {
@@ -726,7 +909,7 @@ void NiceLightsApp::onKeyboardEvent(auto sym)
     break;
   case 'a':
     m_animation++;
-    if(m_animation > icosahedron::GetNumAnimationPatterns())
+    if(m_animation >= icosahedron::PatternRegistry::Instance().count())
       m_animation = 0;
   default:
     break;
@@ -781,6 +964,9 @@ void NiceLightsApp::mainLoop()
     }
 #endif
   }
+
+  m_outputThreadEnabled = false;
+  updateOutputThread();
 }
 
 void NiceLightsApp::handleSerial()
@@ -833,7 +1019,8 @@ void NiceLightsApp::handleSerial()
                 
     static auto mapPot = [](const uint8_t value) -> int {
       float v = mapFader(value);
-      return std::min(icosahedron::GetNumAnimationPatterns()-1, int(v * icosahedron::GetNumAnimationPatterns()));
+      const int numPatterns = icosahedron::PatternRegistry::Instance().count();
+      return std::min(numPatterns-1, int(v * numPatterns));
     };
                 
     m_bankData[0].m_pot = mapPot(packet.m_potA);
@@ -6,25 +6,73 @@
 #include <cstring>
 #include <cstdio>
 #include <list>
+#include <deque>
+#include <chrono>
 #include <functional>
+#include <algorithm>
 
 #include <e131.h>
-#include <unistd.h>
-#ifndef _WIN32
-#include <sys/select.h>
-#endif
 
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp>
 
 #include "icosahedron.hpp"
+#include "colourcorrection.hpp"
 #include "network.hpp"
+#include "showfile.hpp"
 
 const unsigned int MAX_E131_LEDS = (sizeof(((e131_packet_t *)0)->dmp.prop_val) - 1) / 3;
 
 struct NetworkSenderImpl {
-  e131_addr_t m_dest;
-  std::vector<e131_packet_t> m_packets;
+  std::shared_ptr<UniverseSender> m_sender;
+  icosahedron::ColourCorrection m_correction;
+  /// The full precision value of every slot of every universe, MAX_E131_LEDS * 3 to a universe,
+  /// which are truncated or dithered into the packets when they are sent.
+  std::vector<uint16_t> m_wideSlots;
+  /// When dithering, the error carried over from the last time each slot was sent.
+  std::vector<uint8_t> m_ditherError;
+};
+
+/// Most sources that the receiver will merge, any more are ignored.
+const size_t MAX_RECEIVE_SOURCES = 8;
+
+/// How long a source can go without sending before it's forgotten, as E1.31 specifies.
+const std::chrono::milliseconds SOURCE_TIMEOUT(2500);
+
+/// One frame from a source, the data of every universe and the priority it came with.
+struct NetworkReceiverFrame {
+  std::vector<uint8_t> m_data;
+  /// Priority of each universe, -1 until one arrives.
+  std::vector<int16_t> m_priority;
+};
+
+/// Everything the receiver knows about one sender.
+struct NetworkReceiverSource {
+  /// Identifies the sender, the CID from the root layer for E1.31.
+  uint8_t m_cid[16];
+  /// Sequence number of the last packet of each universe, -1 until one arrives.
+  std::vector<int16_t> m_lastSeq;
+  /// When each universe last arrived.
+  std::vector<std::chrono::steady_clock::time_point> m_lastUniverse;
+  /// One bit per universe, set when it has been received for the frame being assembled.
+  std::vector<uint64_t> m_assembled;
+  int m_numAssembled = 0;
+  /// The frame being assembled, complete frames waiting to be shown and the one being shown.
+  /// The merge only uses the priorities of the one being shown, so a source isn't counted until
+  /// its first frame has come through the jitter buffer.
+  NetworkReceiverFrame m_assembling;
+  std::deque<NetworkReceiverFrame> m_ready;
+  NetworkReceiverFrame m_current;
+  /// Is true while the jitter buffer is being played out, until it runs dry.
+  bool m_playing = false;
+  bool m_terminated = false;
+  std::chrono::steady_clock::time_point m_lastPacket;
+};
+
+struct NetworkReceiverImpl {
+  /// One for each protocol, they all feed the same sources.
+  std::vector<std::shared_ptr<UniverseReceiver>> m_transports;
+  std::list<NetworkReceiverSource> m_sources;
 };
 
 static inline float norm(const float f) {
@@ -36,10 +84,17 @@ static inline float norm(const float f) {
     return f;
 }
 
-/*static*/ float GammaCorrection::g_gammaCorrection = 2.2;
-
-static float gamma(const float f) {
-  return pow(norm(f), 1.0/GammaCorrection::g_gammaCorrection);
+/// The DMX slot counts of the universes needed for numLEDs lights, MAX_E131_LEDS to a universe.
+static std::vector<int> UniverseSlotCounts(unsigned int numLEDs)
+{
+  unsigned int numUniverses = (numLEDs / MAX_E131_LEDS)+1;
+  std::vector<int> slotCounts;
+  for(unsigned int n = 0; n<numUniverses; n++) {
+    unsigned int universeSize = std::min(MAX_E131_LEDS, numLEDs);
+    slotCounts.push_back(3 * universeSize);
+    numLEDs -= universeSize;
+  }
+  return slotCounts;
 }
 
 // -----------------------------------------
@@ -48,19 +103,18 @@ static float gamma(const float f) {
 bool NetworkMultiSender::initHosts()
 {
   for(auto& host : m_hosts) {
-    unsigned int numLEDs = host.m_dataEnd;          
-    unsigned int numUniverses = (numLEDs / MAX_E131_LEDS)+1;
+    compileMapping(host);
+
+    const auto slotCounts = UniverseSlotCounts(host.m_dataEnd);
+    const int numUniverses = slotCounts.size();
     host.m_impl = std::shared_ptr<NetworkSenderImpl>(new NetworkSenderImpl);
-    host.m_impl->m_packets.resize(numUniverses);
-
-    for(unsigned int n = 0; n<numUniverses; n++) {
-      auto& packet =  host.m_impl->m_packets[n];
-      strcpy((char *)&packet.frame.source_name, "NiceLights");                
-      unsigned int universeSize = std::min(MAX_E131_LEDS, numLEDs);
-      printf("Init packet, host %s, universe %i, size %i\n", host.m_ipAddr.c_str(), n+host.m_startUniverse, universeSize);
-      e131_pkt_init(&packet, n+host.m_startUniverse, 3 * universeSize);
-      numLEDs -= universeSize;
-    }
+    host.m_impl->m_sender = CreateUniverseSender(host.m_protocol);
+    host.m_impl->m_sender->init(host.m_startUniverse, slotCounts);
+    host.m_impl->m_wideSlots.assign(numUniverses * MAX_E131_LEDS * 3, 0);
+    host.m_impl->m_ditherError.assign(numUniverses * MAX_E131_LEDS * 3, 0);
+
+    for(int n = 0; n<numUniverses; n++)
+      printf("Init packet, host %s, %s universe %i, size %i\n", host.m_ipAddr.c_str(), ProtocolName(host.m_protocol), n+host.m_startUniverse, slotCounts[n] / 3);
   }
 
   return true;
@@ -72,96 +126,287 @@ void NetworkMultiSender::updateEnabled()
         
   if(m_enabled) {
     for(auto& host : m_hosts) {
-      if((host.m_fd = e131_socket()) < 0) {
-	std::cout << "Failed to create socket" << std::endl;
-	return;
-      }
-
       std::string ipAddr(host.m_ipAddr);
       int n = ipAddr.find('-');
       if(n) {
 	ipAddr = ipAddr.substr(0, n);
 	printf("Using %s for %s\n", ipAddr.c_str(), host.m_ipAddr.c_str());
       }
-      if(e131_unicast_dest(&host.m_impl->m_dest, ipAddr.c_str(), E131_DEFAULT_PORT) < 0) {
-	std::cout << "Failed to set E131 unicast destination" << std::endl;
+      if(!host.m_impl->m_sender->open(ipAddr.c_str()))
 	return;
-      }
       m_frameCount = 0;
     }
   } else {
     for(auto& host : m_hosts) {             
-      if(host.m_fd >= 0) {
-	close(host.m_fd);
-	host.m_fd = -1;
-      }
+      if(host.m_impl)
+	host.m_impl->m_sender->close();
     }
   }
 }
 
-void NetworkMultiSender::update(const icosahedron::LightPoint *lightPtr, unsigned int nLights)
+void NetworkMultiSender::update(const icosahedron::LightBuffer& lights)
 {
-  if(!m_enabled)
+  if(!beginFrame())
     return;
+  packLights(lights, {0, int(lights.size())});
+  sendPackets();
+}
+
+bool NetworkMultiSender::beginFrame()
+{
+  if(!m_enabled)
+    return false;
 
   ++m_frameCount;
   if(m_frameCount < m_frameDivisor)
-    return;
+    return false;
   m_frameCount = 0;
-        
+
+  startFrame();
+  return true;
+}
+
+void NetworkMultiSender::sendFrame(const icosahedron::LightBuffer& lights, std::chrono::nanoseconds frameInterval)
+{
+  if(!m_enabled)
+    return;
+  startFrame();
+  packLights(lights, {0, int(lights.size())});
+  if(m_pace)
+    sendPackets(std::chrono::duration_cast<std::chrono::nanoseconds>(frameInterval * std::clamp(m_paceFraction, 0.0f, 1.0f)));
+  else
+    sendPackets();
+}
+
+void NetworkMultiSender::startFrame()
+{
+  // done here rather than in packLights() so the settings can't change part way through a frame.
+  m_ditherFrame = m_dither;
   for(auto& host : m_hosts) {
-    for(auto& range : host.m_ranges) {
-      if((range.m_srcEnd) > nLights) {
-	static bool once = [range, nLights]() {
-	  printf("Range %i %i is outside of the total data area of length %i\n", range.m_srcStart, range.m_srcEnd, nLights);
-	  return true;
-	}();
-	continue;
-      }
+    auto params = host.m_calibration;
+    if(params.m_gamma <= 0.0f)
+      params.m_gamma = m_gamma;
+    host.m_impl->m_correction.update(params);
+  }
+}
 
-      auto WriteLightToPacket = [&](const int destIdx, const int idx) {
-	const int targetUniverse = destIdx / MAX_E131_LEDS;
-	const int packetPos = destIdx % MAX_E131_LEDS;
-	assert(targetUniverse < host.m_impl->m_packets.size());
-	auto& packet = host.m_impl->m_packets[targetUniverse];
-	uint8_t *valPtr = &packet.dmp.prop_val[m_packetStartOffset + (packetPos * 3)];
-	*valPtr++ = (uint8_t)(gamma(lightPtr[idx].px) * 255.0f);
-	*valPtr++ = (uint8_t)(gamma(lightPtr[idx].py) * 255.0f);
-	*valPtr++ = (uint8_t)(gamma(lightPtr[idx].pz) * 255.0f);
-      };
-
-      if(!range.m_reversed) {
-	for(int destIdx = range.m_destOffset, idx = range.m_srcStart; idx<range.m_srcEnd; ++idx, ++destIdx)
-	  WriteLightToPacket(destIdx, idx);
-      } else {
-	for(int destIdx = range.m_destOffset, idx = (range.m_srcEnd-1); idx>=range.m_srcStart; --idx, ++destIdx)
-	  WriteLightToPacket(destIdx, idx);                               
-      }
+void NetworkMultiSender::compileMapping(HostDef& host)
+{
+  host.m_mapping.clear();
+  for(const auto& range : host.m_ranges) {
+    for(int idx = range.m_srcStart; idx<range.m_srcEnd; idx++) {
+      const int destIdx = range.m_destOffset + (range.m_reversed ? range.m_srcEnd - 1 - idx : idx - range.m_srcStart);
+      host.m_mapping.push_back({idx, destIdx * 3});
+    }
+  }
+  // in light order so each chunk of lights is one run of the table, and within a light in slot
+  // order.
+  std::sort(host.m_mapping.begin(), host.m_mapping.end(), [](const MappedLight& a, const MappedLight& b) {
+    return a.m_src < b.m_src || (a.m_src == b.m_src && a.m_destSlot < b.m_destSlot);
+  });
+}
+
+void NetworkMultiSender::packLights(const icosahedron::LightBuffer& lights, icosahedron::LightRange lightRange)
+{
+  const int nLights = lights.size();
+  const float *r = lights.r();
+  const float *g = lights.g();
+  const float *b = lights.b();
+  const int end = std::min(lightRange.m_end, nLights);
+  auto SrcLess = [](const MappedLight& entry, int idx) { return entry.m_src < idx; };
+  for(auto& host : m_hosts) {
+    const auto& mapping = host.m_mapping;
+    if(!mapping.empty() && mapping.back().m_src >= nLights) {
+      static bool once = [nLights]() {
+	printf("The mapping goes outside of the total data area of length %i\n", nLights);
+	return true;
+      }();
+    }
+
+    const auto first = std::lower_bound(mapping.begin(), mapping.end(), lightRange.m_begin, SrcLess);
+    const auto last = std::lower_bound(first, mapping.end(), end, SrcLess);
+
+    const auto& correction = host.m_impl->m_correction;
+    uint16_t *wideSlots = host.m_impl->m_wideSlots.data();
+    for(auto entry = first; entry != last; ++entry) {
+      uint16_t *wide = wideSlots + entry->m_destSlot;
+      const int idx = entry->m_src;
+      wide[0] = correction.lookupWide(0, r[idx]);
+      wide[1] = correction.lookupWide(1, g[idx]);
+      wide[2] = correction.lookupWide(2, b[idx]);
+    }
+  }
+}
+
+void NetworkMultiSender::sendPackets(std::chrono::nanoseconds paceWindow)
+{
+  sendHostPackets(paceWindow, false);
+}
+
+void NetworkMultiSender::sendRecordedPackets(const uint8_t *packets, std::chrono::nanoseconds paceWindow)
+{
+  if(!m_enabled)
+    return;
+  writeRecordedPackets(packets);
+  sendHostPackets(paceWindow, true);
+}
+
+void NetworkMultiSender::sendHostPackets(std::chrono::nanoseconds paceWindow, bool written)
+{
+  const uint16_t syncUniverse = m_sync ? m_syncUniverse : 0;
+  if(paceWindow <= std::chrono::nanoseconds::zero()) {
+    for(auto& host : m_hosts) {
+      if(!written)
+	writePackets(host);
+      auto& sender = *host.m_impl->m_sender;
+      sender.send(sender.numUniverses(), m_batchSend, syncUniverse);
+    }
+  } else {
+    // every host's packets are spread over the window separately, so each controller only ever
+    // has a few waiting to be read.
+    m_pacer.begin(paceWindow);
+    for(size_t h = 0; h<m_hosts.size(); h++) {
+      auto& host = m_hosts[h];
+      if(!written)
+	writePackets(host);
+      auto& sender = *host.m_impl->m_sender;
+      m_pacer.add(h, sender.prepare(sender.numUniverses(), syncUniverse), host.m_paceGap);
     }
+    m_pacer.run([this](int stream, size_t first, size_t num) {
+      m_hosts[stream].m_impl->m_sender->sendPrepared(first, num, m_batchSend);
+    });
+  }
+
+  // the controllers hold the data until this arrives, so it only goes once every host has had
+  // all of its packets.
+  if(syncUniverse) {
+    for(auto& host : m_hosts)
+      host.m_impl->m_sender->sendSync(syncUniverse);
+  }
 
-    for(auto& packet : host.m_impl->m_packets) {
-      packet.frame.seq_number = host.m_seqNumber++;
-      if(e131_send(host.m_fd, &packet, &host.m_impl->m_dest) < 0)
-	std::cout << "E131 sending failed" << std::endl;
+  if(m_recorder) {
+    m_recordFrame.resize(packetFrameSize());
+    copyPackets(m_recordFrame.data());
+    if(!m_recorder->write(m_recordFrame.data())) {
+      printf("Failed to write to the show, stopping recording\n");
+      stopRecording();
     }
   }
 }
 
+void NetworkMultiSender::writePackets(HostDef& host)
+{
+  auto& impl = *host.m_impl;
+  auto& sender = *impl.m_sender;
+  const int universeSlots = MAX_E131_LEDS * 3;
+  // the offset counts the E1.31 start code, which other protocols don't have, and pixel
+  // protocols have no start address at all.
+  const int offset = !sender.isDmx() ? 0 : std::max(m_packetStartOffset - 1, sender.hasStartCode() ? -1 : 0);
+  // don't run off the end of the packet when the data is offset.
+  const int count = std::min(universeSlots, 512 - offset);
+  for(int u = 0; u<sender.numUniverses(); u++) {
+    const uint16_t *wide = &impl.m_wideSlots[u * universeSlots];
+    uint8_t *out = sender.slots(u) + offset;
+    if(m_ditherFrame) {
+      icosahedron::TemporalDither(wide, &impl.m_ditherError[u * universeSlots], out, count);
+    } else {
+      for(int n = 0; n<count; n++)
+	out[n] = wide[n] >> 8;
+    }
+  }
+}
+
+// DDP universes overlap in the slots, each one's last two slots are the start of the next, but
+// copying them in order gives every slot the value of the universe that actually sends it.
+void NetworkMultiSender::writeRecordedPackets(const uint8_t *packets)
+{
+  for(auto& host : m_hosts) {
+    auto& sender = *host.m_impl->m_sender;
+    for(int u = 0; u<sender.numUniverses(); u++) {
+      memcpy(sender.slots(u), packets, SHOW_UNIVERSE_SLOTS);
+      packets += SHOW_UNIVERSE_SLOTS;
+    }
+  }
+}
+
+void NetworkMultiSender::copyPackets(uint8_t *packets)
+{
+  for(auto& host : m_hosts) {
+    auto& sender = *host.m_impl->m_sender;
+    for(int u = 0; u<sender.numUniverses(); u++) {
+      memcpy(packets, sender.slots(u), SHOW_UNIVERSE_SLOTS);
+      packets += SHOW_UNIVERSE_SLOTS;
+    }
+  }
+}
+
+std::string NetworkMultiSender::packetLayout() const
+{
+  std::ostringstream layout;
+  for(const auto& host : m_hosts) {
+    const int numUniverses = host.m_impl ? host.m_impl->m_sender->numUniverses() : 0;
+    layout << host.m_ipAddr << " " << ProtocolName(host.m_protocol) << " " << host.m_startUniverse << " " << numUniverses << "\n";
+  }
+  return layout.str();
+}
+
+size_t NetworkMultiSender::packetFrameSize() const
+{
+  size_t size = 0;
+  for(const auto& host : m_hosts) {
+    if(host.m_impl)
+      size += host.m_impl->m_sender->numUniverses() * SHOW_UNIVERSE_SLOTS;
+  }
+  return size;
+}
+
+bool NetworkMultiSender::startRecording(const std::string& filename, int frameRate)
+{
+  stopRecording();
+  auto recorder = std::make_shared<icosahedron::ShowWriter>();
+  if(!recorder->open(filename, icosahedron::ShowFrameKind::Packets, frameRate, packetFrameSize(), packetLayout()))
+    return false;
+  m_recorder = recorder;
+  printf("Recording packets to %s\n", filename.c_str());
+  return true;
+}
+
+void NetworkMultiSender::stopRecording()
+{
+  if(!m_recorder)
+    return;
+  const size_t numFrames = m_recorder->numFrames();
+  if(m_recorder->close())
+    printf("Recorded %zu frames\n", numFrames);
+  else
+    printf("Failed to write the show\n");
+  m_recorder.reset();
+}
+
 bool NetworkMultiSender::readRangesFile(const std::string& filename)
 {
+  // the recording's layout would no longer match the packets.
+  stopRecording();
   m_enabled = false;
   updateEnabled();
-  m_hosts.clear();
         
   std::ifstream fi(filename);
   if(!fi) {
     printf("Failed to open %s\n", filename.c_str());
+    m_hosts.clear();
     return false;
   }
+  return readRanges(fi);
+}
+
+bool NetworkMultiSender::readRanges(std::istream& input)
+{
+  m_hosts.clear();
+  m_syncUniverse = 0;
 
   int lineNum = 0;
   std::string line;
-  while(std::getline(fi, line)) {
+  while(std::getline(input, line)) {
     ++lineNum;              
     if(line.length() == 0)
       continue;
@@ -188,9 +433,72 @@ bool NetworkMultiSender::readRangesFile(const std::string& filename)
 	printf("Failed to read start universe, line %i\n", lineNum);
 	continue;
       }
-      printf("Adding host %s, start universe %i\n", ipaddr.c_str(), startUniverse);
+      Protocol protocol = Protocol::E131;
+      std::string protocolName;
+      if((strm >> protocolName) && !ParseProtocol(protocolName, protocol)) {
+	printf("Unknown protocol %s, line %i\n", protocolName.c_str(), lineNum);
+	continue;
+      }
+      // E1.31 universes count from 1, the receivers drop universe 0.
+      if(protocol == Protocol::E131 && startUniverse < 1) {
+	printf("E131 universes start at 1, not %i, line %i\n", startUniverse, lineNum);
+	continue;
+      }
+      printf("Adding host %s, start universe %i, %s\n", ipaddr.c_str(), startUniverse, ProtocolName(protocol));
                         
-      m_hosts.push_back({ipaddr, startUniverse});
+      m_hosts.push_back({ipaddr, startUniverse, protocol});
+    } else if(cmd == "sync") {
+      int universe;
+      if(!(strm >> universe) || universe < 0 || universe > 63999) {
+	printf("Failed to read sync universe, line %i\n", lineNum);
+	continue;
+      }
+      printf("Sync universe %i\n", universe);
+      m_syncUniverse = universe;
+    } else if(cmd == "colour") {
+      std::string ipaddr;
+      if(!(strm >> ipaddr)) {
+	printf("Failed to read ipaddr, line %i\n", lineNum);
+	continue;
+      }
+
+      auto itr = std::find_if(m_hosts.begin(), m_hosts.end(), [ipaddr](auto& elem) -> bool {
+	return (elem.m_ipAddr == ipaddr);
+      });
+
+      if(itr == m_hosts.end()) {
+	printf("Unknown host/ipaddr %s, line %i\n", ipaddr.c_str(), lineNum);
+	continue;
+      }
+
+      icosahedron::ColourCorrectionParams params;
+      if(!(strm >> params.m_gamma >> params.m_white[0] >> params.m_white[1] >> params.m_white[2] >> params.m_maxBrightness)) {
+	printf("Failed to read colour correction, line %i\n", lineNum);
+	continue;
+      }
+
+      printf("Colour correction; host %s, gamma %g, white %g %g %g, max %g\n", ipaddr.c_str(), params.m_gamma,
+	     params.m_white[0], params.m_white[1], params.m_white[2], params.m_maxBrightness);
+      itr->m_calibration = params;
+    } else if(cmd == "pace") {
+      std::string ipaddr;
+      int gapUs;
+      if(!(strm >> ipaddr >> gapUs)) {
+	printf("Failed to read pace, line %i\n", lineNum);
+	continue;
+      }
+
+      auto itr = std::find_if(m_hosts.begin(), m_hosts.end(), [ipaddr](auto& elem) -> bool {
+	return (elem.m_ipAddr == ipaddr);
+      });
+
+      if(itr == m_hosts.end()) {
+	printf("Unknown host/ipaddr %s, line %i\n", ipaddr.c_str(), lineNum);
+	continue;
+      }
+
+      printf("Pacing; host %s, at least %i us between packets\n", ipaddr.c_str(), gapUs);
+      itr->m_paceGap = std::chrono::microseconds(std::max(gapUs, 0));
     } else if(cmd == "r" || cmd == "i") {
       int start;
       if(!(strm >> start)) {
@@ -246,34 +554,16 @@ bool NetworkMultiSender::readRangesFile(const std::string& filename)
   return initHosts();
 }
 
-int NetworkMultiSender::whichSide(int idx)
+void NetworkMultiSender::updateTopology(icosahedron::LightTopology& topology) const
 {
-  static auto InRange = [](const DeviceLEDRange& range, int n) -> bool {
-    return (n >= range.m_srcStart && n < range.m_srcEnd);
-  };
-  
-  auto FindRangeForIdx = [this](int n) -> const DeviceLEDRange*{
-    for(auto& host : m_hosts) {
-      for(auto& range : host.m_ranges) {
-        if(InRange(range, n)) {
-          return &range;
-        }
-      }
+  topology.clearMapping();
+  for(int h = 0; h<int(m_hosts.size()); h++) {
+    for(const auto& range : m_hosts[h].m_ranges) {
+      int end = std::min(range.m_srcEnd, topology.size());
+      for(int idx = range.m_srcStart; idx<end; idx++)
+	topology.setMapping(idx, h, range.m_reversed);
     }
-    return nullptr;
-  };
-
-  // reduce the number of searches by caching the last search result
-  static const DeviceLEDRange *lastRange = nullptr;
-  if(lastRange == NULL || !InRange(*lastRange, idx)) {
-    lastRange = FindRangeForIdx(idx);
   }
-  
-  int side = (idx / icosahedron::NUM_LEDS_PER_EDGE) & 1;  
-  if(lastRange && lastRange->m_reversed) {
-    return !side;
-  } else
-    return side;
 }
 
 // -----------------------------------------
@@ -281,31 +571,20 @@ int NetworkMultiSender::whichSide(int idx)
 
 NetworkSender::NetworkSender()
   : m_enabled(false),
-    m_fd(-1),
     m_divisor(3),
     m_frameCount(0),
     m_maxUniverse(0),
-    m_seqNumber(0),
     m_impl(new NetworkSenderImpl) {
+  m_impl->m_sender = CreateUniverseSender(Protocol::E131);
   //strcpy(m_ipAddress, "4.3.2.1");
   strcpy(m_ipAddress, "127.0.0.1");       
 }
 
 void NetworkSender::initPackets(unsigned int numLEDs)
 {
-  unsigned int numUniverses = (numLEDs / MAX_E131_LEDS)+1;
-  m_impl->m_packets.resize(numUniverses);
+  // note universe numbered from 1 not 0
+  m_impl->m_sender->init(1, UniverseSlotCounts(numLEDs));
   m_maxUniverse = 1;
-
-  for(unsigned int n = 0; n<numUniverses; n++) {
-    auto& packet = m_impl->m_packets[n];
-    strcpy((char *)&packet.frame.source_name, "NiceLights");                
-    unsigned int universeSize = std::min(MAX_E131_LEDS, numLEDs);
-    //printf("Universe %i - %u leds\n", (n+1), universeSize);               
-    // note universe numbered from 1 not 0
-    e131_pkt_init(&packet, n+1, 3 * universeSize);
-    numLEDs -= universeSize;
-  }
 }
 
 void NetworkSender::updateEnabled()
@@ -313,21 +592,10 @@ void NetworkSender::updateEnabled()
   std::cout << (m_enabled ? "Enabling":"Disabling") << " E131 sender" << std::endl;
         
   if(m_enabled) {
-    if((m_fd = e131_socket()) < 0) {
-      std::cout << "Failed to create socket" << std::endl;
-      return;
-    }
-
-    if(e131_unicast_dest(&m_impl->m_dest, m_ipAddress, E131_DEFAULT_PORT) < 0) {
-      std::cout << "Failed to set E131 unicast destination" << std::endl;
-      return;
-    }
+    m_impl->m_sender->open(m_ipAddress);
     m_frameCount = 0;
   } else {
-    if(m_fd >= 0) {
-      close(m_fd);
-      m_fd = -1;
-    }
+    m_impl->m_sender->close();
   }
 }
 
@@ -336,178 +604,287 @@ void NetworkSender::updateDivisor()
   m_frameCount = 0;
 }
 
-void NetworkSender::update(const icosahedron::LightPoint *lightPtr, unsigned int nLights)
+void NetworkSender::update(const icosahedron::LightBuffer& lights)
+{
+  if(beginFrame())
+    sendFrame(lights);
+}
+
+bool NetworkSender::beginFrame()
 {
   if(m_enabled) {
     m_frameCount++;
     if(m_frameCount == m_divisor) {
-      sendFrame(lightPtr, nLights);
       m_frameCount = 0;
+      return true;
     }                       
   }
+  return false;
+}
+
+void NetworkSender::sendFrame(const icosahedron::LightBuffer& lights)
+{
+  packLights(lights, {0, int(lights.size())});
+  sendPackets();
 }
 
-void NetworkSender::sendFrame(const icosahedron::LightPoint *lightPtr, unsigned int ledCount)
+void NetworkSender::packLights(const icosahedron::LightBuffer& lights, icosahedron::LightRange range)
 {
-  for(auto& packet : m_impl->m_packets) {
-    uint8_t *valPtr = packet.dmp.prop_val;
-    unsigned int universeSize = std::min(MAX_E131_LEDS, ledCount);
-    for(int c = 0; c<universeSize; c++) {
-      *valPtr++ = (uint8_t)(norm(lightPtr->px) * 255.0);
-      *valPtr++ = (uint8_t)(norm(lightPtr->py) * 255.0);
-      *valPtr++ = (uint8_t)(norm(lightPtr->pz) * 255.0);
-      ++lightPtr;
+  // the lights are sent in order, MAX_E131_LEDS to a universe.
+  auto& sender = *m_impl->m_sender;
+  const int end = std::min(range.m_end, int(sender.numUniverses() * MAX_E131_LEDS));
+  for(int idx = range.m_begin; idx<end; ) {
+    const int universe = idx / MAX_E131_LEDS;
+    const int first = idx % MAX_E131_LEDS;
+    const int count = std::min(end - idx, int(MAX_E131_LEDS) - first);
+    // the receiver expects the lights to start over the start code.
+    uint8_t *valPtr = sender.slots(universe) - 1 + (first * 3);
+    // one plane at a time so each inner loop is a straight strided store.
+    for(int c = 0; c<3; c++) {
+      const float *src = lights.plane(c) + idx;
+      for(int n = 0; n<count; n++)
+	valPtr[(n * 3) + c] = (uint8_t)(norm(src[n]) * 255.0);
     }
-    ledCount -= universeSize;
+    idx += count;
   }
+}
 
-  int universe = 0;
-  for(auto& packet : m_impl->m_packets) {
-    packet.frame.seq_number = m_seqNumber++;
-    if(e131_send(m_fd, &packet, &m_impl->m_dest) < 0)
-      std::cout << "E131 sending failed" << std::endl;
-    ++universe;
-    if(universe >= m_maxUniverse)
-      break;
-  }
+void NetworkSender::sendPackets()
+{
+  m_impl->m_sender->send(std::max(m_maxUniverse, 1), m_batchSend, 0);
 }
 
 int NetworkSender::getNumUniverses() const
 {
-  return m_impl->m_packets.size();
+  return m_impl->m_sender->numUniverses();
 }
 
 // -----------------------------------------
 // -----------------------------------------
 
 NetworkReceiver::NetworkReceiver()
-  : m_fd(-1),
-    m_dontWaitForAllUniverses(false),
+  : m_dontWaitForAllUniverses(false),
     m_enabled(false),
-    m_lastSeq(0x00),
     m_numUniverses(0),
-    m_validUniverses(0)
-{}
+    m_impl(new NetworkReceiverImpl)
+{
+  m_impl->m_transports.push_back(CreateUniverseReceiver(Protocol::E131));
+  m_impl->m_transports.push_back(CreateUniverseReceiver(Protocol::ArtNet));
+}
 
 void NetworkReceiver::init(unsigned int numLEDs)
 {
   m_numUniverses = (numLEDs / MAX_E131_LEDS)+1;
   printf("Num universes: %i, Leds per universe: %i\n", m_numUniverses, MAX_E131_LEDS);
-  m_savedFrame.resize(numLEDs * 3);
+  m_savedFrame.assign(m_numUniverses * MAX_E131_LEDS * 3, 0);
+  m_impl->m_sources.clear();
+}
+
+int NetworkReceiver::getNumSources() const
+{
+  return m_impl->m_sources.size();
 }
 
 void NetworkReceiver::updateEnabled()
 {
-  if(m_fd >= 0) {
-    close(m_fd);
-    m_fd = -1;
-  }
+  for(auto& transport : m_impl->m_transports)
+    transport->close();
         
   if(!m_enabled)
     return;
-        
-  do {
-    if((m_fd = e131_socket()) < 0) {
-      std::cout << "Failed to create socket" << std::endl;
-      return;
-    }
-                
-    if(e131_bind(m_fd, E131_DEFAULT_PORT) < 0) {
-      std::cout << "Failed to bind to port " << E131_DEFAULT_PORT << std::endl;
-      break;
-    }
 
-    /*
-      if(e131_multicast_join(m_fd, 1) < 0) {
-      std::cout << "Failed to join multicast group" << std::endl;
-      break;
-      }
-    */
-    std::cout << "E131 receiver enabled" << std::endl;
-    return;
-  } while(0);
-
-  // fall through to here on error enabling.
-  if(m_fd >= 0) {
-    close(m_fd);
-    m_fd = -1;
-  }
+  // each protocol works on its own, one that can't bind doesn't stop the others.
+  for(auto& transport : m_impl->m_transports)
+    transport->open();
 }
 
-void NetworkReceiver::update(icosahedron::LightPoint *lightPtr, unsigned int nLights)
+void NetworkReceiver::update(icosahedron::LightBuffer& lights)
 {
   if(!m_enabled)
     return;
         
-  e131_packet_t packet;
-  e131_error_t error;
-  timeval tv = {0, 0};
-        
-  while(1) {
-    // keep polling for new data until the socket is empty.
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(m_fd, &fds);
-    int s = select(m_fd+1, &fds, NULL, NULL, &tv);
-    if(s != 1) {
-      break;
-    }
-    auto len = e131_recv(m_fd, &packet);
-    if(len < 0)
-      return;
-    if((error = e131_pkt_validate(&packet)) != E131_ERR_NONE) {
-      std::cout << "Failed E131 packet validate: " << e131_strerror(error) << std::endl;
-      continue;
-    }
+  for(auto& transport : m_impl->m_transports)
+    transport->receive([this](const ReceivedUniverse& universe) { handleUniverse(universe); });
 
-    if(e131_pkt_discard(&packet, m_lastSeq)) {
-      std::cout << "Warning: packet out of order received.\n" << std::endl;
-      m_lastSeq = packet.frame.seq_number;
-    }
-                
-    //e131_pkt_dump(stderr, &packet);
-    m_lastSeq = packet.frame.seq_number;
+  syncLights(lights);
+}
 
-    short universe = ntohs(packet.frame.universe);
-    short propCount = ntohs(packet.dmp.prop_val_cnt);
+void NetworkReceiver::handleUniverse(const ReceivedUniverse& received)
+{
+  auto *source = findSource(received.m_source);
+  if(!source)
+    return;
+  source->m_lastPacket = std::chrono::steady_clock::now();
+
+  // the source has stopped sending, forget it rather than waiting for it to time out.
+  if(received.m_terminated) {
+    source->m_terminated = true;
+    return;
+  }
+
+  const uint16_t universe = received.m_universe;
+  if(universe < 1 || universe > m_numUniverses)
+    return;
 
-    //printf("Received packet %i %i\n", universe, propCount);
+  // sequence numbers are per universe, up to 20 behind the last one is a late packet and
+  // anything further back means the source has restarted.
+  if(received.m_hasSequence) {
+    int16_t& lastSeq = source->m_lastSeq[universe - 1];
+    if(lastSeq >= 0) {
+      const int8_t diff = received.m_sequence - uint8_t(lastSeq);
+      if(diff == 0) {
+	m_stats.m_duplicate++;
+	return;
+      }
+      if(diff < 0 && diff > -20) {
+	m_stats.m_late++;
+	return;
+      }
+      if(diff > 1)
+	m_stats.m_lost += diff - 1;
+    }
+    lastSeq = received.m_sequence;
+  }
+
+  //printf("Received packet %i %i\n", universe, received.m_count);
                 
-    uint8_t *propData = packet.dmp.prop_val;
-    handlePacket(universe, propCount, propData);
+  handlePacket(*source, universe, received.m_priority, received.m_count, received.m_data);
+}
+
+NetworkReceiverSource *NetworkReceiver::findSource(const uint8_t *cid)
+{
+  auto& sources = m_impl->m_sources;
+  for(auto& source : sources) {
+    if(memcmp(source.m_cid, cid, sizeof(source.m_cid)) == 0)
+      return &source;
   }
+  if(sources.size() >= MAX_RECEIVE_SOURCES)
+    return nullptr;
 
-  syncLights(lightPtr, nLights);
+  std::cout << "New receive source" << std::endl;
+  sources.emplace_back();
+  auto& source = sources.back();
+  memcpy(source.m_cid, cid, sizeof(source.m_cid));
+  source.m_lastSeq.assign(m_numUniverses, -1);
+  source.m_assembled.assign((m_numUniverses + 63) / 64, 0);
+  source.m_lastUniverse.assign(m_numUniverses, std::chrono::steady_clock::time_point());
+  for(auto *frame : {&source.m_assembling, &source.m_current}) {
+    frame->m_data.assign(m_savedFrame.size(), 0);
+    frame->m_priority.assign(m_numUniverses, -1);
+  }
+  return &source;
 }
 
-void NetworkReceiver::handlePacket(short universe, short propCount, uint8_t *propData)
+void NetworkReceiver::handlePacket(NetworkReceiverSource& source, uint16_t universe, uint8_t priority, int propCount, const uint8_t *propData)
 {
-  if(universe > m_numUniverses)
-    return;
-        
   // universes are indexed from 1 not zero as we need.
   universe--;
+
+  // a universe that is already in the frame being assembled means the next frame has started,
+  // even if some universes of this one never arrived.
+  uint64_t& word = source.m_assembled[universe / 64];
+  const uint64_t bit = uint64_t(1) << (universe % 64);
+  if(word & bit)
+    finishFrame(source);
         
-  int dataStart = (universe * MAX_E131_LEDS * 3);
-  int dataEnd = dataStart + propCount;
-  m_savedFrame.resize(dataEnd);
-  memcpy(&m_savedFrame[dataStart], propData, propCount);
-  // maintain a bit mask of which universes have been received.
-  m_validUniverses |= (1<<universe);
-}
-
-void NetworkReceiver::syncLights(icosahedron::LightPoint *lightPtr, unsigned int nLights)
-{
-  // if all the universes have been received then copy the data to the rendering.
-  if(m_dontWaitForAllUniverses || ( m_validUniverses == ((1 << (m_numUniverses))-1))) {
-    m_validUniverses = 0;
-    uint8_t *ptr = &m_savedFrame[0];
-    for(unsigned int n = 0; n<nLights; n++) {
-      auto& pnt = *lightPtr++;
-      pnt.px = (*ptr++ / 255.0);
-      pnt.py = (*ptr++ / 255.0);
-      pnt.pz = (*ptr++ / 255.0);
+  // each universe has its own slot in the frame, anything past the end of it is ignored.
+  const int universeSize = MAX_E131_LEDS * 3;
+  memcpy(&source.m_assembling.m_data[universe * universeSize], propData, std::min(propCount, universeSize));
+  source.m_assembling.m_priority[universe] = priority;
+  source.m_lastUniverse[universe] = source.m_lastPacket;
+  // maintain a bitmap of which universes have been received.
+  if(!(word & bit)) {
+    word |= bit;
+    source.m_numAssembled++;
+  }
+
+  if(source.m_numAssembled == m_numUniverses)
+    finishFrame(source);
+}
+
+void NetworkReceiver::finishFrame(NetworkReceiverSource& source)
+{
+  std::fill(source.m_assembled.begin(), source.m_assembled.end(), 0);
+  source.m_numAssembled = 0;
+
+  // when the buffer is full the oldest frame is dropped, and its memory reused.
+  NetworkReceiverFrame frame;
+  if(int(source.m_ready.size()) > m_jitterFrames) {
+    frame = std::move(source.m_ready.front());
+    source.m_ready.pop_front();
+  }
+  // m_assembling is left as it is so the universes that don't arrive for the next frame keep
+  // their data from this one, until the source hasn't sent them for as long as it would take
+  // to time out altogether.
+  const auto now = std::chrono::steady_clock::now();
+  for(int u = 0; u<m_numUniverses; u++) {
+    if(source.m_assembling.m_priority[u] >= 0 && now - source.m_lastUniverse[u] > SOURCE_TIMEOUT)
+      source.m_assembling.m_priority[u] = -1;
+  }
+  frame = source.m_assembling;
+  source.m_ready.push_back(std::move(frame));
+}
+
+void NetworkReceiver::syncLights(icosahedron::LightBuffer& lights)
+{
+  auto& sources = m_impl->m_sources;
+  bool changed = false;
+
+  const auto now = std::chrono::steady_clock::now();
+  for(auto itr = sources.begin(); itr != sources.end(); ) {
+    if(itr->m_terminated || now - itr->m_lastPacket > SOURCE_TIMEOUT) {
+      std::cout << "E131 source lost" << std::endl;
+      itr = sources.erase(itr);
+      changed = true;
+      continue;
+    }
+
+    // show one frame per update, as long as enough are buffered.
+    auto& source = *itr;
+    if(!source.m_ready.empty() && (int(source.m_ready.size()) > m_jitterFrames || source.m_playing)) {
+      std::swap(source.m_current, source.m_ready.front());
+      source.m_ready.pop_front();
+      source.m_playing = !source.m_ready.empty();
+      changed = true;
+    } else if(m_dontWaitForAllUniverses && source.m_numAssembled > 0) {
+      source.m_current = source.m_assembling;
+      changed = true;
     }
+    ++itr;
+  }
+
+  if(!changed)
+    return;
+
+  // for each universe only the sources with the highest priority count, and where there is more
+  // than one of those the brightest value wins.
+  const int universeSize = MAX_E131_LEDS * 3;
+  for(int u = 0; u<m_numUniverses; u++) {
+    int topPriority = -1;
+    for(const auto& source : sources)
+      topPriority = std::max<int>(topPriority, source.m_current.m_priority[u]);
+
+    uint8_t *dst = &m_savedFrame[u * universeSize];
+    bool first = true;
+    for(const auto& source : sources) {
+      if(topPriority < 0 || source.m_current.m_priority[u] != topPriority)
+	continue;
+      const uint8_t *src = &source.m_current.m_data[u * universeSize];
+      if(first)
+	memcpy(dst, src, universeSize);
+      else {
+	for(int n = 0; n<universeSize; n++)
+	  dst[n] = std::max(dst[n], src[n]);
+      }
+      first = false;
+    }
+  }
+
+  const unsigned int nLights = std::min<size_t>(lights.size(), m_savedFrame.size() / 3);
+  const uint8_t *ptr = &m_savedFrame[0];
+  for(int c = 0; c<3; c++) {
+    float *dst = lights.plane(c);
+    for(unsigned int n = 0; n<nLights; n++)
+      dst[n] = (ptr[(n * 3) + c] / 255.0);
   }
 }
-                
@@ -1,17 +1,42 @@
 #pragma once
 
+#include <chrono>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lightbuffer.hpp"
+#include "lighttopology.hpp"
+#include "colourcorrection.hpp"
+#include "transport.hpp"
+#include "pacer.hpp"
+
+/// Slots of each universe in a recorded frame of packets, the whole universe whatever the
+/// protocol sends.
+const int SHOW_UNIVERSE_SLOTS = 512;
+
 class NetworkSenderImpl;
 
-struct GammaCorrection {
-  static float g_gammaCorrection;
-};
+namespace icosahedron {
+class ShowWriter;
+}
+
 class NetworkSender {
 public:
   NetworkSender();
 
-  void update(const icosahedron::LightPoint *lightPtr, unsigned int nLights);
+  void update(const icosahedron::LightBuffer& lights);
   void initPackets(unsigned int numLeds);
-  void sendFrame(const icosahedron::LightPoint *lightPtr, unsigned int nLights);  
+  void sendFrame(const icosahedron::LightBuffer& lights);
+
+  /// Counts a frame, returns true if this is one that should be sent. The frame is then built
+  /// with packLights() and sent with sendPackets().
+  bool beginFrame();
+  /// Writes the lights in range to the packets, can be called from several threads at once for
+  /// different ranges.
+  void packLights(const icosahedron::LightBuffer& lights, icosahedron::LightRange range);
+  void sendPackets();
 
   void updateEnabled();
   void updateDivisor();
@@ -20,48 +45,126 @@ public:
   bool m_enabled;
   int m_divisor;
   int m_maxUniverse;
+  /// Send all the universes with one system call where the platform allows.
+  bool m_batchSend = true;
   char m_ipAddress[64];   
          
 private:
-  int m_fd;
   std::shared_ptr<NetworkSenderImpl> m_impl;
   int m_frameCount;
-  uint8_t m_seqNumber;
 };
 
+class NetworkReceiverImpl;
+struct NetworkReceiverSource;
+
+/// Receives E1.31 and Art-Net from any number of sources. Each source's packets are assembled into frames
+/// separately, with their sequence numbers checked per universe, and held in a short jitter buffer.
+/// The frames of all the sources are then merged: the highest priority source for each universe
+/// wins, and sources with the same priority are merged highest takes precedence.
 class NetworkReceiver {
 public:
+  /// Counts of the packets that were thrown away or never arrived.
+  struct Stats {
+    /// Arrived after a packet with a later sequence number for the same universe.
+    int m_late = 0;
+    /// Skipped over by the sequence numbers.
+    int m_lost = 0;
+    /// Had the same sequence number as the last packet for the universe.
+    int m_duplicate = 0;
+  };
+
   NetworkReceiver();
   void init(unsigned int numLEDs);
-  void update(icosahedron::LightPoint *lightPtr, unsigned int nLights);
+  void update(icosahedron::LightBuffer& lights);
 
   bool m_dontWaitForAllUniverses;
   bool m_enabled;
+  /// Number of complete frames held back from each source to smooth out uneven arrival, 0 to
+  /// always show the newest.
+  int m_jitterFrames = 1;
   void updateEnabled();
+
+  const Stats& stats() const { return m_stats; }
+  int getNumSources() const;
         
 private:
-  void handlePacket(short universe, short propCount, uint8_t *propData);
-  void syncLights(icosahedron::LightPoint *lightPtr, unsigned int nLights);
-  int m_fd;
-  uint8_t m_lastSeq;
+  /// Checks the sequence number of a universe read by one of the transports and assembles it.
+  void handleUniverse(const ReceivedUniverse& received);
+  void handlePacket(NetworkReceiverSource& source, uint16_t universe, uint8_t priority, int propCount, const uint8_t *propData);
+  /// Finds the source with the given CID, adding it if it's new. Returns null if there are
+  /// already too many sources.
+  NetworkReceiverSource *findSource(const uint8_t *cid);
+  /// Moves the frame that the source has been assembling into its jitter buffer.
+  void finishFrame(NetworkReceiverSource& source);
+  void syncLights(icosahedron::LightBuffer& lights);
   int m_numUniverses;
-  unsigned int m_validUniverses;
+  /// The merged data of every universe, MAX_E131_LEDS * 3 bytes to a universe.
   std::vector<uint8_t> m_savedFrame;
+  Stats m_stats;
+  std::shared_ptr<NetworkReceiverImpl> m_impl;
 };
 
 class NetworkMultiSender {
 public:
   NetworkMultiSender() {}
-  void update(const icosahedron::LightPoint *lightPtr, unsigned int nLights);     
+  void update(const icosahedron::LightBuffer& lights);
+
+  /// Counts a frame, returns true if this is one that should be sent. The frame is then built
+  /// with packLights() and sent with sendPackets().
+  bool beginFrame();
+  /// Writes the lights in range to the packets of the hosts they are mapped to, can be called
+  /// from several threads at once for different ranges.
+  void packLights(const icosahedron::LightBuffer& lights, icosahedron::LightRange range);
+  /// Sends the packed frame, spreading the packets over paceWindow if it isn't zero.
+  void sendPackets(std::chrono::nanoseconds paceWindow = std::chrono::nanoseconds::zero());
+
+  /// Packs and sends the lights straight away, ignoring m_frameDivisor. For when something else
+  /// sets the rate, such as the output thread, which passes the time between its frames so the
+  /// packets can be paced.
+  void sendFrame(const icosahedron::LightBuffer& lights, std::chrono::nanoseconds frameInterval = std::chrono::nanoseconds::zero());
+
   bool readRangesFile(const std::string& filename);
+  /// Reads the mapping from input, in the same format as the mapping file.
+  bool readRanges(std::istream& input);
   bool initHosts();
   void updateEnabled();
 
+  /// Records which host drives each light and which strings are reversed.
+  void updateTopology(icosahedron::LightTopology& topology) const;
+
+  /// Describes the hosts and their universes, a show recorded with a different layout can't be
+  /// played with this mapping.
+  std::string packetLayout() const;
+
+  /// Bytes in a frame of packets, every universe of every host in turn, SHOW_UNIVERSE_SLOTS each.
+  size_t packetFrameSize() const;
+
+  /// Sends a frame of packets as recorded in a show, instead of packing the lights. They go
+  /// exactly as they were recorded, the colour correction and the packet offset aren't applied.
+  void sendRecordedPackets(const uint8_t *packets, std::chrono::nanoseconds paceWindow = std::chrono::nanoseconds::zero());
+
+  /// Records every frame of packets sent from now on into a show file, until stopRecording() or
+  /// the mapping file is read again. frameRate is only stored in the file for playing it back.
+  bool startRecording(const std::string& filename, int frameRate);
+  void stopRecording();
+  bool recording() const { return m_recorder != nullptr; }
+
   bool m_enabled = false;
   int m_frameDivisor = 2; 
   int m_packetStartOffset = 1;
-
-  int whichSide(int n);
+  /// Gamma for the hosts that don't have their own in the mapping file.
+  float m_gamma = 2.2f;
+  /// Keep the precision that 8 bit output loses and spread it over the following frames.
+  bool m_dither = false;
+  /// Send each host's universes with one system call where the platform allows.
+  bool m_batchSend = true;
+  /// Have the controllers wait for a sync packet after each frame so they all update together,
+  /// when the mapping file gives a sync universe.
+  bool m_sync = true;
+  /// Spread each frame's packets evenly over m_paceFraction of the frame interval instead of
+  /// sending them in one burst. Only when sendFrame() is given the interval.
+  bool m_pace = false;
+  float m_paceFraction = 0.5f;
         
 protected:
   struct DeviceLEDRange {
@@ -70,18 +173,61 @@ protected:
     int m_destOffset = 0;
     bool m_reversed = false;
   };
+
+  /// One light of a host's mapping, compiled from its ranges.
+  struct MappedLight {
+    /// Index of the light.
+    int m_src;
+    /// Index of its red slot in the host's wide slots, the universe's slots followed by the next.
+    int m_destSlot;
+  };
         
   struct HostDef {
     std::string m_ipAddr;
     int m_startUniverse = -1;
-    int m_fd = -1;
+    Protocol m_protocol = Protocol::E131;
     std::vector<DeviceLEDRange> m_ranges;                   
+    /// Every light in m_ranges, sorted by light index, which is what packLights() works from.
+    std::vector<MappedLight> m_mapping;
     std::shared_ptr<NetworkSenderImpl> m_impl;
-    uint8_t m_seqNumber = 0;
     int m_dataEnd = 0;
+    /// Colour correction from the mapping file, a gamma of 0 follows m_gamma.
+    icosahedron::ColourCorrectionParams m_calibration = {0.0f};
+    /// Least time between two packets to the host when pacing, from the mapping file.
+    std::chrono::microseconds m_paceGap{0};
   };
         
+  /// Latches the settings used for the frame about to be packed.
+  void startFrame();
+
+  /// Builds host.m_mapping from its ranges.
+  static void compileMapping(HostDef& host);
+
+  /// Truncates or dithers the full precision values of the last frame into the host's packets.
+  void writePackets(HostDef& host);
+
+  /// Copies a frame of recorded packets into the hosts' packets.
+  void writeRecordedPackets(const uint8_t *packets);
+
+  /// Copies the hosts' packets out into a frame of packetFrameSize() bytes.
+  void copyPackets(uint8_t *packets);
+
+  /// Sends the hosts' packets, calling writePackets() for each host first unless they have already
+  /// been written.
+  void sendHostPackets(std::chrono::nanoseconds paceWindow, bool written);
+
   std::vector<HostDef> m_hosts;
+  PacketPacer m_pacer;
+
+  /// Universe of the sync packets from the mapping file, 0 when there isn't one.
+  uint16_t m_syncUniverse = 0;
+
+  /// m_dither as it was at the start of the frame being packed.
+  bool m_ditherFrame = false;
+
+  /// Records the packets after they're sent, when recording.
+  std::shared_ptr<icosahedron::ShowWriter> m_recorder;
+  std::vector<uint8_t> m_recordFrame;
         
   int m_frameCount = 0;
         
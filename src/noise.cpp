@@ -0,0 +1,78 @@
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "simdops.hpp"
+#include "noise.hpp"
+
+namespace icosahedron
+{
+
+namespace simd_scalar {
+#include "noisekernels.inl"
+}
+
+#ifdef NICE_LIGHTS_X86_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+namespace simd_sse2 {
+#include "noisekernels.inl"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace simd_avx2 {
+#include "noisekernels.inl"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace simd_avx512 {
+#include "noisekernels.inl"
+}
+#pragma GCC pop_options
+
+#endif
+
+void PerlinNoiseBatch(const float *x, const float *y, const float *z, float *out, int count)
+{
+  int done = DISPATCH_RUN(PerlinNoiseRun, x, y, z, out, count);
+  simd_scalar::PerlinNoiseRun(x + done, y + done, z + done, out + done, count - done);
+}
+
+void NoiseField::build(const float *x, const float *y, int count, float scale)
+{
+  m_size = count;
+  for(auto *v : {&m_fx, &m_fy, &m_ux, &m_uy, &m_hash[0], &m_hash[1], &m_hash[2], &m_hash[3]})
+    v->resize(count);
+
+  // this only happens when the lights change so there's no need for anything but scalar.
+  for(int n = 0; n<count; n++) {
+    float ix0, ix1, iy0, iy1;
+    simd_scalar::LatticeTerms(x[n] * scale, ix0, ix1, m_fx[n], m_ux[n]);
+    simd_scalar::LatticeTerms(y[n] * scale, iy0, iy1, m_fy[n], m_uy[n]);
+    float hash[4];
+    simd_scalar::CornerHashes(ix0, ix1, iy0, iy1, hash);
+    for(int c = 0; c<4; c++)
+      m_hash[c][n] = hash[c];
+  }
+}
+
+void NoiseField::evaluate(float z, int begin, int end, float *out) const
+{
+  const float *hash[4] = {m_hash[0].data() + begin, m_hash[1].data() + begin, m_hash[2].data() + begin, m_hash[3].data() + begin};
+  const float *fx = m_fx.data() + begin;
+  const float *fy = m_fy.data() + begin;
+  const float *ux = m_ux.data() + begin;
+  const float *uy = m_uy.data() + begin;
+  const int count = end - begin;
+
+  int done = DISPATCH_RUN(NoiseFieldRun, fx, fy, ux, uy, hash, z, out, count);
+  const float *hashRest[4] = {hash[0] + done, hash[1] + done, hash[2] + done, hash[3] + done};
+  simd_scalar::NoiseFieldRun(fx + done, fy + done, ux + done, uy + done, hashRest, z, out + done, count - done);
+}
+
+}
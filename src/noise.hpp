@@ -0,0 +1,37 @@
+#pragma once
+
+#include "lightbuffer.hpp"
+
+namespace icosahedron {
+
+/// Evaluates classic 3D Perlin noise, the same algorithm as glm::perlin(vec3), at count points
+/// held as separate x, y and z arrays. Uses the best SIMD implementation for the CPU, see
+/// simd.hpp, and every implementation gives the same result.
+void PerlinNoiseBatch(const float *x, const float *y, const float *z, float *out, int count);
+
+/// Perlin noise over a fixed set of (x, y) points where only z changes between calls, as in the
+/// plasma patterns where z is time. Everything that only depends on x and y, including the
+/// hashes of the lattice corners, is worked out once in build() so each evaluation is left with
+/// the z dependent half of the work.
+class NoiseField {
+public:
+  /// Precomputes the lattice terms for the points (x[i] * scale, y[i] * scale).
+  void build(const float *x, const float *y, int count, float scale);
+
+  int size() const { return m_size; }
+
+  /// Writes the noise at (x[i] * scale, y[i] * scale, z) for i in [begin, end) to out[0] to
+  /// out[end - begin - 1]. Safe to call from several threads at once.
+  void evaluate(float z, int begin, int end, float *out) const;
+
+private:
+  int m_size = 0;
+  /// Position within the lattice cell.
+  AlignedFloatVector m_fx, m_fy;
+  /// Fade curve of the position within the cell.
+  AlignedFloatVector m_ux, m_uy;
+  /// Hashes of the four corners of the cell.
+  AlignedFloatVector m_hash[4];
+};
+
+}
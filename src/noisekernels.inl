@@ -0,0 +1,131 @@
+// Classic 3D Perlin noise kernels shared by every instruction set in noise.cpp, see
+// colourkernels.inl for how these are included.
+//
+// This is the same algorithm, operation for operation, as glm::perlin(vec3) (Stefan
+// Gustavson's GLSL noise) but with each SIMD lane evaluating a different point.
+
+static inline V Fract(V x)
+{
+  return Sub(x, Floor(x));
+}
+
+static inline V Mod289(V x)
+{
+  return Sub(x, Mul(Floor(Mul(x, Set1(1.0f / 289.0f))), Set1(289.0f)));
+}
+
+static inline V Permute(V x)
+{
+  return Mod289(Mul(Add(Mul(x, Set1(34.0f)), Set1(1.0f)), x));
+}
+
+static inline V Fade(V t)
+{
+  return Mul(Mul(Mul(t, t), t), Add(Mul(t, Sub(Mul(t, Set1(6.0f)), Set1(15.0f))), Set1(10.0f)));
+}
+
+static inline V Mix(V a, V b, V t)
+{
+  return Add(Mul(a, Sub(Set1(1.0f), t)), Mul(b, t));
+}
+
+static inline V Dot(V ax, V ay, V az, V bx, V by, V bz)
+{
+  return Add(Add(Mul(ax, bx), Mul(ay, by)), Mul(az, bz));
+}
+
+/// Splits a coordinate into the wrapped lattice cell either side of it, the position within the
+/// cell and the fade curve of that position.
+static inline void LatticeTerms(V p, V& i0, V& i1, V& f, V& u)
+{
+  V fl = Floor(p);
+  i0 = Mod289(fl);
+  i1 = Mod289(Add(fl, Set1(1.0f)));
+  f = Fract(p);
+  u = Fade(f);
+}
+
+/// Hashes of the four (x, y) lattice corners, these only depend on x and y.
+static inline void CornerHashes(V ix0, V ix1, V iy0, V iy1, V hash[4])
+{
+  hash[0] = Permute(Add(Permute(ix0), iy0));
+  hash[1] = Permute(Add(Permute(ix1), iy0));
+  hash[2] = Permute(Add(Permute(ix0), iy1));
+  hash[3] = Permute(Add(Permute(ix1), iy1));
+}
+
+/// Contribution of one corner: its pseudo random gradient dotted with the offset to the point.
+static inline V CornerGradient(V hash, V iz, V dx, V dy, V dz)
+{
+  V h = Permute(Add(hash, iz));
+  V gx = Mul(h, Set1(1.0f / 7.0f));
+  V gy = Sub(Fract(Mul(Floor(gx), Set1(1.0f / 7.0f))), Set1(0.5f));
+  gx = Fract(gx);
+  V gz = Sub(Sub(Set1(0.5f), Abs(gx)), Abs(gy));
+  V sz = Step(gz, Set1(0.0f));
+  gx = Sub(gx, Mul(sz, Sub(Step(Set1(0.0f), gx), Set1(0.5f))));
+  gy = Sub(gy, Mul(sz, Sub(Step(Set1(0.0f), gy), Set1(0.5f))));
+
+  V norm = Sub(Set1(1.79284291400159f), Mul(Set1(0.85373472095314f), Dot(gx, gy, gz, gx, gy, gz)));
+  gx = Mul(gx, norm);
+  gy = Mul(gy, norm);
+  gz = Mul(gz, norm);
+  return Dot(gx, gy, gz, dx, dy, dz);
+}
+
+static inline V NoiseFromLattice(V fx, V fy, V ux, V uy, const V hash[4], V iz0, V iz1, V fz, V uz)
+{
+  V fx1 = Sub(fx, Set1(1.0f));
+  V fy1 = Sub(fy, Set1(1.0f));
+  V fz1 = Sub(fz, Set1(1.0f));
+
+  V n000 = CornerGradient(hash[0], iz0, fx, fy, fz);
+  V n100 = CornerGradient(hash[1], iz0, fx1, fy, fz);
+  V n010 = CornerGradient(hash[2], iz0, fx, fy1, fz);
+  V n110 = CornerGradient(hash[3], iz0, fx1, fy1, fz);
+  V n001 = CornerGradient(hash[0], iz1, fx, fy, fz1);
+  V n101 = CornerGradient(hash[1], iz1, fx1, fy, fz1);
+  V n011 = CornerGradient(hash[2], iz1, fx, fy1, fz1);
+  V n111 = CornerGradient(hash[3], iz1, fx1, fy1, fz1);
+
+  V nz0 = Mix(n000, n001, uz);
+  V nz1 = Mix(n100, n101, uz);
+  V nz2 = Mix(n010, n011, uz);
+  V nz3 = Mix(n110, n111, uz);
+  V nyz0 = Mix(nz0, nz2, uy);
+  V nyz1 = Mix(nz1, nz3, uy);
+  return Mul(Set1(2.2f), Mix(nyz0, nyz1, ux));
+}
+
+// Each of these evaluates whole vectors from the start of the arrays and returns how many
+// points were done, the caller finishes any remainder with the scalar versions.
+
+static int PerlinNoiseRun(const float *x, const float *y, const float *z, float *out, int count)
+{
+  int i = 0;
+  for(; i + WIDTH <= count; i += WIDTH) {
+    V ix0, ix1, fx, ux;
+    V iy0, iy1, fy, uy;
+    V iz0, iz1, fz, uz;
+    LatticeTerms(Load(x + i), ix0, ix1, fx, ux);
+    LatticeTerms(Load(y + i), iy0, iy1, fy, uy);
+    LatticeTerms(Load(z + i), iz0, iz1, fz, uz);
+    V hash[4];
+    CornerHashes(ix0, ix1, iy0, iy1, hash);
+    Store(out + i, NoiseFromLattice(fx, fy, ux, uy, hash, iz0, iz1, fz, uz));
+  }
+  return i;
+}
+
+static int NoiseFieldRun(const float *fx, const float *fy, const float *ux, const float *uy, const float *const hash[4], float z, float *out, int count)
+{
+  V iz0, iz1, fz, uz;
+  LatticeTerms(Set1(z), iz0, iz1, fz, uz);
+
+  int i = 0;
+  for(; i + WIDTH <= count; i += WIDTH) {
+    V h[4] = {Load(hash[0] + i), Load(hash[1] + i), Load(hash[2] + i), Load(hash[3] + i)};
+    Store(out + i, NoiseFromLattice(Load(fx + i), Load(fy + i), Load(ux + i), Load(uy + i), h, iz0, iz1, fz, uz));
+  }
+  return i;
+}
@@ -0,0 +1,77 @@
+#include <chrono>
+
+#include "outputthread.hpp"
+
+namespace icosahedron
+{
+
+OutputThread::~OutputThread()
+{
+  stop();
+}
+
+void OutputThread::start(int rateHz, const SendCallback& fn)
+{
+  stop();
+  setRate(rateHz);
+  m_send = fn;
+  m_quit = false;
+  m_thread = std::thread(&OutputThread::threadMain, this);
+}
+
+void OutputThread::stop()
+{
+  if(!m_thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_all();
+  m_thread.join();
+  m_measuredRate.store(0.0f, std::memory_order_relaxed);
+}
+
+void OutputThread::threadMain()
+{
+  typedef std::chrono::steady_clock Clock;
+
+  auto next = Clock::now();
+  auto rateStart = next;
+  int rateFrames = 0;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while(!m_quit) {
+    lock.unlock();
+
+    m_frames.acquire();
+    const LightBuffer& lights = m_frames.readBuffer();
+    // nothing has been rendered yet.
+    if(!lights.empty()) {
+      std::lock_guard<std::mutex> sendLock(m_sendMutex);
+      m_send(lights);
+    }
+
+    auto now = Clock::now();
+    ++rateFrames;
+    std::chrono::duration<float> elapsed = now - rateStart;
+    if(elapsed.count() >= 1.0f) {
+      m_measuredRate.store(rateFrames / elapsed.count(), std::memory_order_relaxed);
+      rateStart = now;
+      rateFrames = 0;
+    }
+
+    // keep to the same schedule so the rate doesn't drift by however long each send took, but if
+    // the thread has fallen more than a frame behind start again from now rather than sending a
+    // burst of frames to catch up.
+    const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_rateHz.load(std::memory_order_relaxed)));
+    next += period;
+    if(next < now - period)
+      next = now;
+
+    lock.lock();
+    m_wake.wait_until(lock, next, [this]() { return m_quit; });
+  }
+}
+
+}
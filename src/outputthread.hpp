@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "lightbuffer.hpp"
+
+namespace icosahedron {
+
+/// Hands whole frames of lights from one writer thread to one reader thread without either
+/// waiting on the other.
+///
+/// There are three buffers: the writer fills one, the reader sends from another and the third
+/// holds the newest completed frame. publish() swaps the writer's buffer with the spare one and
+/// acquire() swaps the reader's buffer with it if it holds a frame the reader hasn't had yet. The
+/// reader always gets the latest frame and frames that arrive faster than it reads are dropped.
+class FrameTripleBuffer {
+public:
+  /// The buffer for the writer to fill.
+  LightBuffer& writeBuffer() { return m_buffers[m_write]; }
+
+  /// Passes the write buffer to the reader, writeBuffer() is then a different buffer.
+  void publish() {
+    m_write = m_spare.exchange(m_write | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  /// Takes the newest published frame if there is one the reader hasn't had yet. Returns false
+  /// and leaves readBuffer() as it was if nothing new has been published.
+  bool acquire() {
+    if(!(m_spare.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    m_read = m_spare.exchange(m_read, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+
+  /// The frame the reader last acquired.
+  const LightBuffer& readBuffer() const { return m_buffers[m_read]; }
+
+private:
+  static const int INDEX_MASK = 3;
+  /// Set alongside the spare buffer's index when it holds a frame the reader hasn't acquired.
+  static const int FRESH = 4;
+
+  LightBuffer m_buffers[3];
+  int m_write = 0;
+  int m_read = 1;
+  std::atomic<int> m_spare{2};
+};
+
+/// Sends the lights to the rig from its own thread at a fixed rate, so the output doesn't follow
+/// the display's refresh rate or stop when the GUI stalls.
+///
+/// The renderer publishes each frame it animates into frames(). The thread wakes on a monotonic
+/// clock, takes the newest frame and passes it to the send callback, sending the last frame again
+/// if no new one has arrived.
+class OutputThread {
+public:
+  typedef std::function<void(const LightBuffer& lights)> SendCallback;
+
+  OutputThread() {}
+  ~OutputThread();
+
+  OutputThread(const OutputThread&) = delete;
+  OutputThread& operator=(const OutputThread&) = delete;
+
+  /// Starts sending with fn at rateHz frames per second, restarting the thread if it's running.
+  void start(int rateHz, const SendCallback& fn);
+  void stop();
+  bool running() const { return m_thread.joinable(); }
+
+  /// Changes the rate of a running thread from its next frame.
+  void setRate(int rateHz) { m_rateHz.store(std::max(rateHz, 1), std::memory_order_relaxed); }
+  int rate() const { return m_rateHz.load(std::memory_order_relaxed); }
+
+  /// Where the renderer publishes each frame it has finished.
+  FrameTripleBuffer& frames() { return m_frames; }
+
+  /// Held by the thread while it sends, which with paced sending is most of each frame. Take it
+  /// before changing anything the send callback uses, such as enabling the senders, but only for
+  /// the change itself rather than every frame.
+  std::unique_lock<std::mutex> lockSenders() { return std::unique_lock<std::mutex>(m_sendMutex); }
+
+  /// Frames per second actually sent, measured over the last second.
+  float measuredRate() const { return m_measuredRate.load(std::memory_order_relaxed); }
+
+private:
+  void threadMain();
+
+  std::thread m_thread;
+  SendCallback m_send;
+  FrameTripleBuffer m_frames;
+
+  std::atomic<int> m_rateHz{50};
+  std::atomic<float> m_measuredRate{0.0f};
+
+  std::mutex m_sendMutex;
+
+  /// Used to wake the thread early when stopping.
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_quit = false;
+};
+
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <time.h>
+#include <errno.h>
+#include <sys/prctl.h>
+#endif
+
+#include "pacer.hpp"
+
+void SleepUntil(std::chrono::steady_clock::time_point when)
+{
+#ifdef __linux__
+  // the default timer slack lets each sleep run up to 50us over, which is most of the gap
+  // between packets at high rates.
+  thread_local bool slackSet = false;
+  if(!slackSet) {
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    slackSet = true;
+  }
+
+  // the steady clock is CLOCK_MONOTONIC, so sleep on that directly until the absolute time.
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(when.time_since_epoch()).count();
+  timespec ts;
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+    ;
+#else
+  std::this_thread::sleep_until(when);
+#endif
+}
+
+void PacketPacer::begin(std::chrono::nanoseconds window)
+{
+  m_window = std::max(window, std::chrono::nanoseconds::zero());
+  m_schedule.clear();
+}
+
+void PacketPacer::add(int stream, size_t count, std::chrono::nanoseconds minGap)
+{
+  if(!count)
+    return;
+  const auto gap = std::max(m_window / int64_t(count), minGap);
+  for(size_t n = 0; n<count; n++)
+    m_schedule.push_back({gap * int64_t(n), stream, n});
+}
+
+void PacketPacer::run(const SendCallback& fn)
+{
+  // stable so that packets due at the same time keep the order the streams were added in.
+  std::stable_sort(m_schedule.begin(), m_schedule.end(), [](const Slot& a, const Slot& b) {
+    return a.m_due < b.m_due;
+  });
+
+  const auto start = std::chrono::steady_clock::now();
+  for(size_t n = 0; n<m_schedule.size(); ) {
+    const auto& slot = m_schedule[n];
+    if(slot.m_due > std::chrono::steady_clock::now() - start)
+      SleepUntil(start + slot.m_due);
+
+    // take the stream's following packets along with this one if they're already due.
+    const auto now = std::chrono::steady_clock::now() - start;
+    size_t end = n + 1;
+    while(end < m_schedule.size() && m_schedule[end].m_stream == slot.m_stream &&
+	  m_schedule[end].m_index == m_schedule[end - 1].m_index + 1 && m_schedule[end].m_due <= now)
+      end++;
+
+    fn(slot.m_stream, slot.m_index, end - n);
+    n = end;
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// Sleeps until when on the steady clock, as precisely as the platform allows.
+void SleepUntil(std::chrono::steady_clock::time_point when);
+
+/// Spreads the packets of a frame evenly over a window of time rather than sending them in one
+/// burst, which can overrun the receive buffers of small controllers.
+///
+/// Each stream, one for each host, has its packets spaced evenly across the window, or further
+/// apart if it has a minimum gap. The streams are interleaved, and run() sleeps until each packet
+/// is due on the monotonic clock before handing it over to be sent.
+class PacketPacer {
+public:
+  typedef std::function<void(int stream, size_t first, size_t num)> SendCallback;
+
+  /// Starts a new schedule for packets sent over window.
+  void begin(std::chrono::nanoseconds window);
+
+  /// Adds count packets to send for stream, no closer together than minGap.
+  void add(int stream, size_t count, std::chrono::nanoseconds minGap);
+
+  /// Sends the schedule from now, calling fn for each run of a stream's packets as it falls due.
+  /// Packets that are late by the time the ones before them have gone are sent together.
+  void run(const SendCallback& fn);
+
+private:
+  struct Slot {
+    /// When the packet is due, from the start of the schedule.
+    std::chrono::nanoseconds m_due;
+    int m_stream;
+    size_t m_index;
+  };
+
+  std::chrono::nanoseconds m_window{0};
+  std::vector<Slot> m_schedule;
+};
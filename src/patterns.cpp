@@ -0,0 +1,586 @@
+#define _USE_MATH_DEFINES
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <glm/gtc/noise.hpp>
+
+#include "icosahedron.hpp"
+#include "colourspace.hpp"
+#include "noise.hpp"
+#include "patterns.hpp"
+#include "spatialgrid.hpp"
+#include "threadpool.hpp"
+
+namespace icosahedron
+{
+
+// -----------------------------------------------
+// Helpers
+// -----------------------------------------------
+
+static void ClearColours(LightBuffer& colours, LightRange range)
+{
+  for(int c = 0; c<3; c++) {
+    float *plane = colours.plane(c);
+    for(int n = range.m_begin; n<range.m_end; n++)
+      plane[n] = 0.0f;
+  }
+}
+
+void MixInsideOutside(LightBuffer& colours, float mix, const uint8_t *sides, LightRange range)
+{
+  float sideMix[2] = {(mix * 2.0f), (1.0f - mix) * 2.0f};
+  float *r = colours.r();
+  float *g = colours.g();
+  float *b = colours.b();
+  for(int n = range.m_begin; n<range.m_end; n++) {
+    const float sm = sideMix[sides[n]];
+    r[n] *= sm;
+    g[n] *= sm;
+    b[n] *= sm;
+  }
+}
+
+/// Lights up the target edge, flashing it and running a single coloured light along it.
+static void FixedEdgesPattern(LightBuffer& colours, float t, int target, LightRange range)
+{
+  float step = fmod(t, 1.0f);
+  float flash = 1.0f - ((fabs(step - 0.5f)) * 2.0f);
+  int idxLed = int(step * NUM_LEDS_PER_EDGE);
+
+  glm::vec3 colorLed = HSVtoRGB(step * 360.f, 0.7, 1.0);
+  glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f) * flash * 0.3f;
+
+  // each edge has a string of lights on both the inside and the outside.
+  const int edgeStart = target * NUM_LEDS_PER_EDGE * 2;
+  const int begin = std::max(range.m_begin, edgeStart);
+  const int end = std::min(range.m_end, edgeStart + (NUM_LEDS_PER_EDGE * 2));
+  for(int idx = begin; idx<end; idx++) {
+    int n = (idx - edgeStart) / 2;
+    colours.set(idx, (n == idxLed) ? colorLed : color);
+  }
+}
+
+/// Scratch space for a block of lit lights whose colours are converted from HSV in one batch
+/// and then written back to their lights.
+struct HSVBlock {
+  static const int SIZE = 256;
+
+  int m_count = 0;
+  alignas(64) int m_idx[SIZE];
+  alignas(64) float m_h[SIZE];
+  alignas(64) float m_s[SIZE];
+  alignas(64) float m_v[SIZE];
+
+  void push(int idx, float h, float s, float v) {
+    m_idx[m_count] = idx;
+    m_h[m_count] = h;
+    m_s[m_count] = s;
+    m_v[m_count] = v;
+    ++m_count;
+  }
+
+  /// Converts the block in place, afterwards h, s and v hold r, g and b.
+  void convert() {
+    HSVtoRGBBatch(m_h, m_s, m_v, m_h, m_s, m_v, m_count);
+  }
+
+  void addTo(LightBuffer& colours) const {
+    for(int n = 0; n<m_count; n++)
+      colours.add(m_idx[n], glm::vec3(m_h[n], m_s[n], m_v[n]));
+  }
+
+  void setIn(LightBuffer& colours) const {
+    for(int n = 0; n<m_count; n++)
+      colours.set(m_idx[n], glm::vec3(m_h[n], m_s[n], m_v[n]));
+  }
+};
+
+/// The lights that a plane effect might reach this frame. They are found from the grid once in
+/// prepare() so that each evaluate() only looks at the ones in its range.
+struct SlabLights {
+  std::vector<int> m_lights;
+
+  /// Finds the lights that might be within width of the plane where (xform * pos).x is 0.
+  void find(const PatternFrame& frame, const LightBuffer& positions, const glm::mat4& xform, float width) {
+    m_lights.clear();
+    if(!frame.m_grid || frame.m_grid->size() != int(positions.size())) {
+      m_lights.resize(positions.size());
+      std::iota(m_lights.begin(), m_lights.end(), 0);
+      return;
+    }
+    // (xform * pos).x is the first row of the matrix dotted with pos.
+    const glm::vec3 normal(xform[0][0], xform[1][0], xform[2][0]);
+    frame.m_grid->queryPlane(normal, xform[3][0], width, m_lights);
+  }
+
+  /// The lights found that are in range, as [first, second).
+  std::pair<const int *, const int *> in(LightRange range) const {
+    const int *begin = std::lower_bound(m_lights.data(), m_lights.data() + m_lights.size(), range.m_begin);
+    const int *end = std::lower_bound(begin, m_lights.data() + m_lights.size(), range.m_end);
+    return {begin, end};
+  }
+};
+
+typedef std::function<float(const glm::vec3&)> HueCallback;
+
+static const float RING_WIDTH = 0.2f;
+
+static void BaseRingPattern(const LightBuffer& positions, LightBuffer& colours, const glm::mat4& xform, const HueCallback& func, const SlabLights& slab, LightRange range)
+{
+  float width = RING_WIDTH;
+  const float *px = positions.x();
+  const float *py = positions.y();
+  const float *pz = positions.z();
+  auto [first, last] = slab.in(range);
+  for(const int *start = first; start<last; start += HSVBlock::SIZE) {
+    const int *end = std::min(last, start + HSVBlock::SIZE);
+    HSVBlock block;
+    for(const int *light = start; light<end; light++) {
+      const int n = *light;
+      glm::vec4 pos = glm::vec4(px[n], py[n], pz[n], 1.0);
+      pos = xform * pos;
+
+      float d = fabs(pos.x);
+      if(d < width) {
+	float v = 1.0 - (d / width);
+	v *= 1.3;
+	v = v* v * v * v;
+	block.push(n, func(pos), 0.7, v);
+      }
+    }
+    block.convert();
+    block.addTo(colours);
+  }
+}
+
+static glm::mat4 ManualRotation(const float *params)
+{
+  glm::mat4 xform = glm::rotate(glm::mat4(1.0), float(params[0] * M_PI), glm::vec3(0.0, 1.0, 0.0));
+  xform = glm::rotate(xform, float(params[1] * M_PI), glm::vec3(1.0, 0.0, 0.0));
+  xform = glm::rotate(xform, float(params[2] * M_PI), glm::vec3(0.0, 0.0, 1.0));
+  return xform;
+}
+
+/// Base of the patterns that light up a single ring, which is where (xform * pos).x is close to 0.
+class SingleRingPattern : public Pattern {
+public:
+  void prepare(const PatternFrame& frame, const LightBuffer& positions) override {
+    m_xform = transform(frame);
+    m_slab.find(frame, positions, m_xform, RING_WIDTH);
+  }
+
+protected:
+  /// Works out the position of the ring for this frame.
+  virtual glm::mat4 transform(const PatternFrame& frame) const = 0;
+
+  glm::mat4 m_xform;
+  SlabLights m_slab;
+};
+
+// -----------------------------------------------
+// Patterns
+// -----------------------------------------------
+
+class MovingDotPattern : public Pattern {
+public:
+  const char *name() const override { return "Moving Dot"; }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    int target = int(fmod(frame.m_time * 200.0, float(colours.size())));
+    for(int n = range.m_begin; n<range.m_end; n++) {
+      if(n + 1 == target)
+	colours.set(n, glm::vec3(1, 1, 1));
+      else
+	colours.set(n, glm::vec3(0, 0, 0));
+    }
+  }
+};
+
+class MovingEdgesPattern : public Pattern {
+public:
+  const char *name() const override { return "Moving Edges"; }
+
+  float loopPeriod(const PatternFrame& frame) const override {
+    return GetIcosahedronEdges().size();
+  }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const auto& edges = GetIcosahedronEdges();
+    int target = int(fmod(frame.m_time, float(edges.size())));
+    FixedEdgesPattern(colours, frame.m_time, target, range);
+  }
+};
+
+class HighlightEdgePattern : public Pattern {
+public:
+  const char *name() const override { return "Highlight Edge"; }
+
+  float loopPeriod(const PatternFrame& frame) const override { return 1.0f; }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    FixedEdgesPattern(colours, frame.m_time, frame.m_arg-1, range);
+  }
+};
+
+class ManualRingPattern : public SingleRingPattern {
+public:
+  const char *name() const override { return "Manual Control Ring"; }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const float *params = frame.m_params;
+    BaseRingPattern(positions, colours, m_xform, [params](const glm::vec3& pos) { return params[3] * 360.0; }, m_slab, range);
+  }
+
+protected:
+  glm::mat4 transform(const PatternFrame& frame) const override {
+    return ManualRotation(frame.m_params);
+  }
+};
+
+class Ring1Pattern : public SingleRingPattern {
+public:
+  const char *name() const override { return "Ring1"; }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const float time = frame.m_time;
+    BaseRingPattern(positions, colours, m_xform, [time](const glm::vec3& pos) { return fmod(time * 100.0, 360.0f); }, m_slab, range);
+  }
+
+protected:
+  glm::mat4 transform(const PatternFrame& frame) const override {
+    const float time = frame.m_time;
+    glm::mat4 xform = glm::rotate(glm::mat4(1.0), time * 3.0f, glm::vec3(0.0, 1.0, 0.0));
+    xform = glm::rotate(xform, time * 2.0f, glm::vec3(1.0, 0.0, 0.0));
+    xform = glm::rotate(xform, time * 0.5f, glm::vec3(0.0, 0.0, 1.0));
+    return xform;
+  }
+};
+
+class Ring2Pattern : public SingleRingPattern {
+public:
+  const char *name() const override { return "Ring2"; }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const float time = frame.m_time;
+    BaseRingPattern(positions, colours, m_xform,
+		    [time](const glm::vec3& pos) {
+		      float h = ((atan2(pos.z, pos.y) / glm::pi<float>()) * 180.0) + (time * 100.0);
+		      h = fmod(h, 360.0);
+		      return h;
+		    }, m_slab, range);
+  }
+
+protected:
+  glm::mat4 transform(const PatternFrame& frame) const override {
+    return glm::rotate(glm::mat4(1.0), frame.m_time * 2.0f, glm::vec3(0.0, 1.0, 0.0));
+  }
+};
+
+class SweepPattern : public Pattern {
+public:
+  const char *name() const override { return "Sweep"; }
+
+  /// The sweep repeats every 4/3s and the hue every 5s.
+  float loopPeriod(const PatternFrame& frame) const override { return 20.0f; }
+
+  void prepare(const PatternFrame& frame, const LightBuffer& positions) override {
+    const float sweep = 2.0;
+    m_xform = glm::translate(glm::mat4(1.0f), glm::vec3(fmod(frame.m_time * 3.0, sweep * 2.0f) - sweep, 0, 0));
+    m_xform = m_xform * ManualRotation(frame.m_params);
+    m_slab.find(frame, positions, m_xform, WIDTH);
+  }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const float time = frame.m_time;
+    const float *params = frame.m_params;
+    float h = fmod(time * 0.2, 1.0) * 360.0;
+
+    float width = WIDTH;
+    const float *px = positions.x();
+    const float *py = positions.y();
+    const float *pz = positions.z();
+    auto [first, last] = m_slab.in(range);
+    for(const int *start = first; start<last; start += HSVBlock::SIZE) {
+      const int *end = std::min(last, start + HSVBlock::SIZE);
+      HSVBlock block;
+      for(const int *light = start; light<end; light++) {
+	const int n = *light;
+	glm::vec4 pos = glm::vec4(px[n], py[n], pz[n], 1.0);
+	pos = m_xform * pos;
+
+	float t = fabs(pos.x);
+	if(t < width) {
+	  float v = pow(1.0f - (t / width), 1.0f / params[3]);
+	  block.push(n, h, v, v);
+	}
+      }
+      block.convert();
+      block.setIn(colours);
+    }
+  }
+
+private:
+  static constexpr float WIDTH = 0.4f;
+
+  glm::mat4 m_xform;
+  SlabLights m_slab;
+};
+
+/// Three rings that tumble around each other. The rotation speeds are integrated so the angles are
+/// per-instance state. They are integrated in fixed steps of STEP seconds from time zero up to the
+/// frame's time rather than once a frame, so the rings move the same at any frame rate and the
+/// angles depend only on the time, not on when the pattern was first shown or what came before.
+class MultiRingPattern : public Pattern {
+public:
+  const char *name() const override { return "Multi Ring"; }
+
+  void prepare(const PatternFrame& frame, const LightBuffer& positions) override {
+    // the speeds were tuned by eye one step per frame at 60 frames a second.
+    const float STEP = 1.0f / 60.0f;
+    // the angles are saved every this many steps so going back in time only integrates from the
+    // checkpoint before it rather than from zero.
+    const int64_t CHECKPOINT_STEPS = 600;
+
+    // because we are accumulating this value every step then this number is senstive.
+    const float sf = 0.11;
+    const float fixedFactor = 0.01;
+
+    const int64_t lastStep = std::max<int64_t>(int64_t(frame.m_time / STEP), 0);
+
+    // going back in time, such as the clock being reset, starts again from the checkpoint before it.
+    if(lastStep < m_step) {
+      const int64_t checkpoint = lastStep / CHECKPOINT_STEPS;
+      m_rx = m_checkpoints[checkpoint].x;
+      m_ry = m_checkpoints[checkpoint].y;
+      m_rz = m_checkpoints[checkpoint].z;
+      m_step = checkpoint * CHECKPOINT_STEPS;
+    }
+
+    for(; m_step<lastStep; m_step++) {
+      if(m_step % CHECKPOINT_STEPS == 0 && m_step / CHECKPOINT_STEPS == int64_t(m_checkpoints.size()))
+	m_checkpoints.push_back(glm::vec3(m_rx, m_ry, m_rz));
+
+      const float time = m_step * STEP;
+      const auto Integrate = [&](float& r, float noiseOffset) {
+	r += glm::perlin(glm::vec2(time * 0.1f, noiseOffset)) * sf;
+	if(r > 0.0)
+	  r += fixedFactor;
+	else
+	  r -= fixedFactor;
+      };
+
+      Integrate(m_rx, 0.0f);
+      Integrate(m_ry, 10.0f);
+      Integrate(m_rz, 20.0f);
+    }
+
+    glm::mat4 xformA = glm::rotate(glm::mat4(1.0), m_rx, glm::vec3(0.0, 0.0, 1.0));
+    glm::mat4 xformB = glm::rotate(glm::mat4(1.0), m_ry, glm::vec3(0.0, 1.0, 0.0));
+    glm::mat4 xformC = glm::rotate(glm::mat4(1.0), m_rz, glm::vec3(1.0, 0.0, 0.0));
+
+    m_xform[0] = xformA;
+    m_xform[1] = xformA * xformB;
+    m_xform[2] = xformA * xformB * xformC;
+
+    for(int i = 0; i<3; i++)
+      m_slab[i].find(frame, positions, m_xform[i], RING_WIDTH);
+  }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    BaseRingPattern(positions, colours, m_xform[0], [](const glm::vec3& pos) { return 1.0; }, m_slab[0], range);
+    BaseRingPattern(positions, colours, m_xform[1], [](const glm::vec3& pos) { return 90.0; }, m_slab[1], range);
+    BaseRingPattern(positions, colours, m_xform[2], [](const glm::vec3& pos) { return 180.0; }, m_slab[2], range);
+  }
+
+private:
+  float m_rx = 0.0f;
+  float m_ry = 0.0f;
+  float m_rz = 0.0f;
+  /// The next step to integrate, and the angles at every CHECKPOINT_STEPS steps integrated so far.
+  int64_t m_step = 0;
+  std::vector<glm::vec3> m_checkpoints;
+  glm::mat4 m_xform[3];
+  SlabLights m_slab[3];
+};
+
+class InsideOutPattern : public Pattern {
+public:
+  const char *name() const override { return "Inside Out"; }
+
+  /// The hue repeats every 5s and the mix every 2 / (3 * speed) seconds. They only line up when
+  /// some whole number of hue cycles is within a small part of a whole number of mix cycles, so
+  /// the jump where the loop starts again can't be seen.
+  float loopPeriod(const PatternFrame& frame) const override {
+    const int MAX_HUE_CYCLES = 12;
+    const float TOLERANCE = 0.001f;
+    const float mixCyclesPerHue = 5.0f * 3.0f * frame.m_params[0] / 2.0f;
+    for(int n = 1; n<=MAX_HUE_CYCLES; n++) {
+      const float mixCycles = n * mixCyclesPerHue;
+      if(fabs(mixCycles - std::round(mixCycles)) < TOLERANCE)
+	return n * 5.0f;
+    }
+    return 0.0f;
+  }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const float time = frame.m_time;
+    float mix = fabs(fmod(time * 3.0f * frame.m_params[0], 2.0f) - 1.0f);
+    float sideMix[2] = {(mix * 2.0f), (1.0f - mix) * 2.0f};
+    float h = fmod(time * 0.2, 1.0) * 360.0;
+
+    const glm::vec3 c = HSVtoRGB(h, 1.0, 1.0);
+    const uint8_t *sides = frame.sides();
+    for(int n = range.m_begin; n<range.m_end; n++)
+      colours.set(n, c * sideMix[sides[n]]);
+  }
+};
+
+/// Base of the plasma patterns, which are noise over the x/z plane of the lights animated along
+/// the third noise axis.
+class BasePlasmaPattern : public Pattern {
+public:
+  void prepare(const PatternFrame& frame, const LightBuffer& positions) override {
+    // the light positions are fixed so the x/z half of the noise only needs working out once.
+    if(m_fieldPositions != &positions || m_field.size() != int(positions.size())) {
+      m_field.build(positions.x(), positions.z(), positions.size(), 10.0f);
+      m_fieldPositions = &positions;
+    }
+  }
+
+protected:
+  NoiseField m_field;
+  const LightBuffer *m_fieldPositions = nullptr;
+};
+
+class PlasmaPattern : public BasePlasmaPattern {
+public:
+  const char *name() const override { return "Plasma"; }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const float *params = frame.m_params;
+    const float z = frame.m_time * params[0] * 10.0f;
+    for(int start = range.m_begin; start<range.m_end; start += HSVBlock::SIZE) {
+      const int count = std::min(range.m_end - start, HSVBlock::SIZE);
+      HSVBlock block;
+      m_field.evaluate(z, start, start + count, block.m_h);
+      for(int i = 0; i<count; i++) {
+	float h = (block.m_h[i] + 1.0f) * 0.5f;
+	block.m_h[i] = h * 360.f;
+	block.m_s[i] = params[1];
+	block.m_v[i] = params[2];
+      }
+      // the lights are contiguous so convert straight into the colour planes.
+      HSVtoRGBBatch(block.m_h, block.m_s, block.m_v, colours.r() + start, colours.g() + start, colours.b() + start, count);
+    }
+  }
+};
+
+class SpecklyPlasmaPattern : public BasePlasmaPattern {
+public:
+  const char *name() const override { return "Speckly Plasma"; }
+
+  void evaluate(const PatternFrame& frame, const LightBuffer& positions, LightBuffer& colours, LightRange range) const override {
+    const float *params = frame.m_params;
+    const float zHue = frame.m_time * params[0] * 10.0f;
+    const float zValue = frame.m_time * params[2] * 10.0f;
+    for(int start = range.m_begin; start<range.m_end; start += HSVBlock::SIZE) {
+      const int count = std::min(range.m_end - start, HSVBlock::SIZE);
+      HSVBlock block;
+      m_field.evaluate(zHue, start, start + count, block.m_h);
+      m_field.evaluate(zValue, start, start + count, block.m_v);
+      for(int i = 0; i<count; i++) {
+	float h = (block.m_h[i] + 1.0f) * 0.5f;
+	float v = (block.m_v[i] + 1.0f) * 0.5f;
+	block.m_h[i] = h * 360.f;
+	block.m_s[i] = params[1];
+	block.m_v[i] = pow(v, 1.0f / params[3]);
+      }
+      HSVtoRGBBatch(block.m_h, block.m_s, block.m_v, colours.r() + start, colours.g() + start, colours.b() + start, count);
+    }
+  }
+};
+
+// -----------------------------------------------
+// Registry
+// -----------------------------------------------
+
+PatternRegistry& PatternRegistry::Instance()
+{
+  static PatternRegistry *inst = new PatternRegistry;
+  return *inst;
+}
+
+PatternRegistry::PatternRegistry()
+{
+  // the order here is the order of the GUI list and the mixer pots, so only append.
+  add<MovingDotPattern>();
+  add<MovingEdgesPattern>();
+  add<HighlightEdgePattern>();
+  add<ManualRingPattern>();
+  add<Ring1Pattern>();
+  add<Ring2Pattern>();
+  add<SweepPattern>();
+  add<MultiRingPattern>();
+  add<InsideOutPattern>();
+  add<PlasmaPattern>();
+  add<SpecklyPlasmaPattern>();
+}
+
+void PatternRegistry::add(Factory factory)
+{
+  // make a throwaway instance just to ask it for its name.
+  m_names.push_back(factory()->name());
+  m_factories.push_back(factory);
+}
+
+std::unique_ptr<Pattern> PatternRegistry::create(int idx) const
+{
+  if(idx < 0 || idx >= count())
+    return nullptr;
+  return m_factories[idx]();
+}
+
+// -----------------------------------------------
+// Evaluation
+// -----------------------------------------------
+
+void EvaluateLightColours(const Pattern& pattern, const LightBuffer& positions, LightBuffer& colours, const PatternFrame& frame, LightRange range)
+{
+  ClearColours(colours, range);
+  pattern.evaluate(frame, positions, colours, range);
+  MixInsideOutside(colours, frame.m_insideOutsideMix, frame.sides(), range);
+}
+
+void AnimateLightColours(Pattern& pattern, const LightBuffer& positions, LightBuffer& colours, const PatternFrame& frame)
+{
+  pattern.prepare(frame, positions);
+  EvaluateLightColours(pattern, positions, colours, frame, {0, int(colours.size())});
+}
+
+void AnimateLightColours(Pattern& pattern, const LightBuffer& positions, LightBuffer& colours, const PatternFrame& frame, ThreadPool& pool, const LightsDoneCallback& onLightsDone)
+{
+  // a couple of edges per chunk is enough work to be worth handing to another thread, while still
+  // leaving plenty of chunks for the threads to balance between them.
+  const int LIGHTS_PER_CHUNK = NUM_LEDS_PER_EDGE * 2;
+
+  pattern.prepare(frame, positions);
+  pool.parallelFor(colours.size(), LIGHTS_PER_CHUNK, [&](int begin, int end) {
+    EvaluateLightColours(pattern, positions, colours, frame, {begin, end});
+    if(onLightsDone)
+      onLightsDone(colours, {begin, end});
+  });
+}
+
+}
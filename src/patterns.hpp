@@ -0,0 +1,125 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+
+namespace icosahedron {
+
+class ThreadPool;
+class SpatialGrid;
+
+/// Everything that a pattern is given about the current frame.
+struct PatternFrame {
+  float m_time = 0.0f;
+  /// Extra integer argument, currently the edge to highlight.
+  int m_arg = 0;
+  const float *m_params = nullptr;
+  int m_nParams = 0;
+  float m_insideOutsideMix = 0.5f;
+  /// Where each light is on the rig.
+  const LightTopology *m_topology = nullptr;
+  /// Use the sides as wired in the mapping file rather than as built.
+  bool m_useMappedSides = false;
+  /// Index of the light positions, optional but without it the plane effects look at every light.
+  const SpatialGrid *m_grid = nullptr;
+
+  /// Which side, inside or outside, each light is on.
+  const uint8_t *sides() const {
+    return m_useMappedSides ? m_topology->m_mappedSide.data() : m_topology->m_side.data();
+  }
+};
+
+/// Base class of all the light animations.
+///
+/// Any state that carries over between frames belongs to the pattern instance and is only
+/// advanced in prepare(), which is called once per frame. evaluate() must only read that state
+/// so it can be called for disjoint ranges of the same frame in any order, or from several
+/// threads at once.
+class Pattern {
+public:
+  virtual ~Pattern() = default;
+
+  /// Name shown in the GUI.
+  virtual const char *name() const = 0;
+
+  /// Advances any per-instance state to the given frame. This is also where a pattern can
+  /// build tables from the light positions, which rarely change.
+  virtual void prepare(const PatternFrame& frame, const LightBuffer& positions) {}
+
+  /// Seconds after which the frames repeat exactly with the frame's parameters, which lets them be
+  /// baked once and replayed. 0 if they never do, which is the default.
+  virtual float loopPeriod(const PatternFrame& frame) const { return 0.0f; }
+
+  /// Writes the colours of the lights in range. The colours have already been cleared to black.
+  virtual void evaluate(const PatternFrame& frame,
+			const LightBuffer& positions,
+			LightBuffer& colours,
+			LightRange range) const = 0;
+};
+
+/// The list of all the patterns that the app knows about, in the order that the GUI and the
+/// mixer hardware select them.
+class PatternRegistry {
+public:
+  typedef std::function<std::unique_ptr<Pattern>()> Factory;
+
+  /// Fetch the registry of built in patterns.
+  static PatternRegistry& Instance();
+
+  /// Adds a pattern to the end of the list.
+  void add(Factory factory);
+
+  int count() const { return m_factories.size(); }
+  const char *name(int idx) const { return m_names[idx]; }
+  const char *const *names() const { return m_names.data(); }
+
+  /// Creates a new instance with its own state of the pattern at idx.
+  std::unique_ptr<Pattern> create(int idx) const;
+
+private:
+  PatternRegistry();
+
+  template<typename T> void add() {
+    add([]() -> std::unique_ptr<Pattern> { return std::make_unique<T>(); });
+  }
+
+  std::vector<Factory> m_factories;
+  std::vector<const char *> m_names;
+};
+
+/// Runs a whole frame of a pattern: prepares it, then clears, evaluates and applies the
+/// inside/outside mix to every light.
+void AnimateLightColours(Pattern& pattern,
+			 const LightBuffer& positions,
+			 LightBuffer& colours,
+			 const PatternFrame& frame);
+
+/// Called with each chunk of lights as soon as its colours are final, on whichever thread
+/// evaluated it.
+typedef std::function<void(const LightBuffer& colours, LightRange range)> LightsDoneCallback;
+
+/// As above but with the lights split into chunks of whole edges that are spread over the pool's
+/// threads. The output is the same as the single threaded version. If onLightsDone is set then it
+/// is passed each chunk while it is still in the cache, which lets the senders pack the frame in
+/// the same pass.
+void AnimateLightColours(Pattern& pattern,
+			 const LightBuffer& positions,
+			 LightBuffer& colours,
+			 const PatternFrame& frame,
+			 ThreadPool& pool,
+			 const LightsDoneCallback& onLightsDone = LightsDoneCallback());
+
+/// Clears, evaluates and applies the inside/outside mix to just the lights in range. The
+/// pattern must already have been prepared for this frame.
+void EvaluateLightColours(const Pattern& pattern,
+			  const LightBuffer& positions,
+			  LightBuffer& colours,
+			  const PatternFrame& frame,
+			  LightRange range);
+
+/// Scales the lights in range by mix * 2 on the outside and (1 - mix) * 2 on the inside, so 0.5
+/// leaves them as they are. This is the last step of EvaluateLightColours().
+void MixInsideOutside(LightBuffer& colours, float mix, const uint8_t *sides, LightRange range);
+
+}
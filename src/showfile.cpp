@@ -0,0 +1,363 @@
+#include <cstring>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "showfile.hpp"
+
+namespace icosahedron
+{
+
+// The encoded data is a list of runs, each starting with a control byte c. When c is below 128 it
+// is followed by c + 1 literal bytes. Up to 254 it is followed by one byte that repeats c - 125
+// times, repeats are 3 to 129 bytes long as shorter ones are cheaper as literals. 255 is followed
+// by the length of a run of zeros of any length, 7 bits at a time with the top bit set on all but
+// the last, so an unchanged frame is a few bytes whatever its size.
+static const int MAX_LITERAL = 128;
+static const int MIN_REPEAT = 3;
+static const int MAX_REPEAT = 129;
+static const int REPEAT_BIAS = 125;
+static const int ZERO_RUN = 255;
+
+void EncodeFrameDelta(const uint8_t *frame, const uint8_t *prev, size_t size, std::vector<uint8_t>& out)
+{
+  const auto delta = [&](size_t i) -> uint8_t { return prev ? uint8_t(frame[i] - prev[i]) : frame[i]; };
+
+  size_t literalStart = 0;
+  const auto flushLiterals = [&](size_t end) {
+    while(literalStart < end) {
+      const size_t len = std::min<size_t>(MAX_LITERAL, end - literalStart);
+      out.push_back(len - 1);
+      for(size_t i = literalStart; i<literalStart + len; i++)
+	out.push_back(delta(i));
+      literalStart += len;
+    }
+  };
+
+  size_t n = 0;
+  while(n < size) {
+    const uint8_t v = delta(n);
+    size_t run = 1;
+    while(n + run < size && (v == 0 || run < size_t(MAX_REPEAT)) && delta(n + run) == v)
+      run++;
+    if(run >= size_t(MIN_REPEAT)) {
+      flushLiterals(n);
+      if(run > size_t(MAX_REPEAT)) {
+	out.push_back(ZERO_RUN);
+	for(size_t len = run; ; len >>= 7) {
+	  out.push_back((len & 0x7f) | (len > 0x7f ? 0x80 : 0));
+	  if(len <= 0x7f)
+	    break;
+	}
+      } else {
+	out.push_back(run + REPEAT_BIAS);
+	out.push_back(v);
+      }
+      literalStart = n + run;
+    }
+    n += run;
+  }
+  flushLiterals(size);
+}
+
+bool DecodeFrameDelta(const uint8_t *data, size_t dataSize, uint8_t *frame, size_t size, bool keyframe)
+{
+  size_t pos = 0;
+  size_t n = 0;
+  while(pos < dataSize) {
+    const int c = data[pos++];
+    if(c < MAX_LITERAL) {
+      const size_t len = c + 1;
+      if(pos + len > dataSize || n + len > size)
+	return false;
+      if(keyframe) {
+	memcpy(frame + n, data + pos, len);
+      } else {
+	for(size_t i = 0; i<len; i++)
+	  frame[n + i] += data[pos + i];
+      }
+      pos += len;
+      n += len;
+    } else if(c == ZERO_RUN) {
+      size_t len = 0;
+      for(int shift = 0; ; shift += 7) {
+	if(pos >= dataSize || shift > 56)
+	  return false;
+	const uint8_t b = data[pos++];
+	len |= size_t(b & 0x7f) << shift;
+	if(!(b & 0x80))
+	  break;
+      }
+      if(n + len > size)
+	return false;
+      if(keyframe)
+	memset(frame + n, 0, len);
+      n += len;
+    } else {
+      const size_t len = c - REPEAT_BIAS;
+      if(pos >= dataSize || n + len > size)
+	return false;
+      const uint8_t v = data[pos++];
+      if(keyframe) {
+	memset(frame + n, v, len);
+      } else if(v) {
+	for(size_t i = 0; i<len; i++)
+	  frame[n + i] += v;
+      }
+      n += len;
+    }
+  }
+  return n == size;
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+bool ShowWriter::open(const std::string& filename, ShowFrameKind kind, int frameRate, size_t frameSize, const std::string& layout, int keyframeInterval)
+{
+  close();
+  m_file = fopen(filename.c_str(), "wb");
+  if(!m_file) {
+    printf("Failed to create %s\n", filename.c_str());
+    return false;
+  }
+
+  m_header = ShowFileHeader();
+  memcpy(m_header.m_magic, ShowFileHeader::MAGIC, sizeof(m_header.m_magic));
+  m_header.m_kind = uint32_t(kind);
+  m_header.m_frameRate = frameRate;
+  m_header.m_frameSize = frameSize;
+  m_header.m_keyframeInterval = keyframeInterval > 0 ? keyframeInterval : std::max(1, frameRate * 2);
+  m_header.m_layoutSize = layout.size();
+  m_index.clear();
+  m_prev.assign(frameSize, 0);
+  m_failed = fwrite(&m_header, sizeof(m_header), 1, m_file) != 1 ||
+    (!layout.empty() && fwrite(layout.data(), layout.size(), 1, m_file) != 1);
+  m_offset = sizeof(m_header) + layout.size();
+  return !m_failed;
+}
+
+bool ShowWriter::close()
+{
+  if(!m_file)
+    return false;
+
+  ShowFileFooter footer;
+  footer.m_indexOffset = m_offset;
+  footer.m_numFrames = m_index.size();
+  memcpy(footer.m_magic, ShowFileFooter::MAGIC, sizeof(footer.m_magic));
+  if((!m_index.empty() && fwrite(m_index.data(), sizeof(m_index[0]), m_index.size(), m_file) != m_index.size()) ||
+     fwrite(&footer, sizeof(footer), 1, m_file) != 1)
+    m_failed = true;
+  if(fclose(m_file) != 0)
+    m_failed = true;
+  m_file = nullptr;
+  return !m_failed;
+}
+
+bool ShowWriter::write(const uint8_t *frame)
+{
+  if(!m_file || m_failed)
+    return false;
+
+  const bool keyframe = m_index.size() % m_header.m_keyframeInterval == 0;
+  m_encoded.clear();
+  EncodeFrameDelta(frame, keyframe ? nullptr : m_prev.data(), m_prev.size(), m_encoded);
+
+  ShowRecordHeader record;
+  record.m_size = m_encoded.size();
+  record.m_flags = keyframe ? ShowRecordHeader::KEYFRAME : 0;
+  if(fwrite(&record, sizeof(record), 1, m_file) != 1 ||
+     fwrite(m_encoded.data(), m_encoded.size(), 1, m_file) != 1 ||
+     fflush(m_file) != 0) {
+    m_failed = true;
+    return false;
+  }
+
+  m_index.push_back(m_offset);
+  m_offset += sizeof(record) + m_encoded.size();
+  memcpy(m_prev.data(), frame, m_prev.size());
+  return true;
+}
+
+// -----------------------------------------
+// -----------------------------------------
+
+bool ShowReader::open(const std::string& filename)
+{
+  close();
+
+#ifdef _WIN32
+  FILE *file = fopen(filename.c_str(), "rb");
+  if(!file) {
+    printf("Failed to open %s\n", filename.c_str());
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  m_contents.resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  const bool ok = m_contents.empty() || fread(m_contents.data(), m_contents.size(), 1, file) == 1;
+  fclose(file);
+  if(!ok) {
+    printf("Failed to read %s\n", filename.c_str());
+    return false;
+  }
+  m_data = m_contents.data();
+  m_size = m_contents.size();
+#else
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    printf("Failed to open %s\n", filename.c_str());
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size == 0) {
+    printf("Failed to read %s\n", filename.c_str());
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if(data == MAP_FAILED) {
+    printf("Failed to map %s\n", filename.c_str());
+    return false;
+  }
+  // shows are mostly played from start to end, so let the kernel read ahead.
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  m_data = static_cast<const uint8_t *>(data);
+  m_size = st.st_size;
+#endif
+
+  if(m_size < sizeof(m_header)) {
+    printf("%s is too short to be a show\n", filename.c_str());
+    close();
+    return false;
+  }
+  memcpy(&m_header, m_data, sizeof(m_header));
+  if(memcmp(m_header.m_magic, ShowFileHeader::MAGIC, sizeof(m_header.m_magic)) != 0 ||
+     m_header.m_version != ShowFileHeader::VERSION ||
+     sizeof(m_header) + m_header.m_layoutSize > m_size) {
+    printf("%s is not a show this version can play\n", filename.c_str());
+    close();
+    return false;
+  }
+  m_layout.assign(reinterpret_cast<const char *>(m_data + sizeof(m_header)), m_header.m_layoutSize);
+  const size_t framesStart = sizeof(m_header) + m_header.m_layoutSize;
+
+  ShowFileFooter footer;
+  if(m_size >= framesStart + sizeof(footer))
+    memcpy(&footer, m_data + m_size - sizeof(footer), sizeof(footer));
+  const bool finished = m_size >= framesStart + sizeof(footer) &&
+    memcmp(footer.m_magic, ShowFileFooter::MAGIC, sizeof(footer.m_magic)) == 0 &&
+    footer.m_indexOffset >= framesStart && footer.m_indexOffset <= m_size - sizeof(footer);
+  // the frames end where the index starts, or at the end of a file that wasn't finished.
+  const size_t framesEnd = finished ? footer.m_indexOffset : m_size;
+  bool indexed = finished &&
+    footer.m_numFrames <= m_size / sizeof(uint64_t) &&
+    footer.m_indexOffset + footer.m_numFrames * sizeof(uint64_t) + sizeof(footer) == m_size;
+  ShowRecordHeader record;
+  if(indexed) {
+    m_index.resize(footer.m_numFrames);
+    memcpy(m_index.data(), m_data + footer.m_indexOffset, m_index.size() * sizeof(uint64_t));
+    // every frame must lie between the layout and the index.
+    for(const uint64_t offset : m_index) {
+      if(offset < framesStart || offset + sizeof(record) > framesEnd) {
+	indexed = false;
+	break;
+      }
+      memcpy(&record, m_data + offset, sizeof(record));
+      if(offset + sizeof(record) + record.m_size > framesEnd) {
+	indexed = false;
+	break;
+      }
+    }
+    if(!indexed) {
+      printf("%s has a corrupt index, reading the frames without it\n", filename.c_str());
+      m_index.clear();
+    }
+  }
+  if(!indexed) {
+    // not finished, or the index can't be trusted, so find the frames that were written
+    // completely.
+    size_t pos = framesStart;
+    while(pos + sizeof(record) <= framesEnd) {
+      memcpy(&record, m_data + pos, sizeof(record));
+      if(pos + sizeof(record) + record.m_size > framesEnd)
+	break;
+      m_index.push_back(pos);
+      pos += sizeof(record) + record.m_size;
+    }
+  }
+
+  m_frame.assign(m_header.m_frameSize, 0);
+  m_decoded = -1;
+  return true;
+}
+
+void ShowReader::close()
+{
+#ifdef _WIN32
+  m_contents.clear();
+#else
+  if(m_data)
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+  m_data = nullptr;
+  m_size = 0;
+  m_index.clear();
+  m_layout.clear();
+  m_frame.clear();
+  m_decoded = -1;
+}
+
+const uint8_t *ShowReader::frame(size_t n)
+{
+  if(n >= m_index.size())
+    return nullptr;
+  if(long(n) == m_decoded)
+    return m_frame.data();
+
+  // go back to the keyframe, unless the frame already decoded is between it and n.
+  size_t keyframe = n;
+  ShowRecordHeader record;
+  for(; keyframe > 0; keyframe--) {
+    if(m_index[keyframe] + sizeof(record) > m_size)
+      return nullptr;
+    memcpy(&record, m_data + m_index[keyframe], sizeof(record));
+    if(record.m_flags & ShowRecordHeader::KEYFRAME)
+      break;
+  }
+  size_t first = keyframe;
+  if(m_decoded >= long(keyframe) && m_decoded < long(n))
+    first = m_decoded + 1;
+  else if(keyframe == 0)
+    std::fill(m_frame.begin(), m_frame.end(), 0);
+
+  for(size_t i = first; i<=n; i++) {
+    if(!decode(i)) {
+      m_decoded = -1;
+      return nullptr;
+    }
+  }
+  m_decoded = n;
+  return m_frame.data();
+}
+
+bool ShowReader::decode(size_t n)
+{
+  const uint64_t pos = m_index[n];
+  ShowRecordHeader record;
+  if(pos + sizeof(record) > m_size)
+    return false;
+  memcpy(&record, m_data + pos, sizeof(record));
+  if(pos + sizeof(record) + record.m_size > m_size)
+    return false;
+  return DecodeFrameDelta(m_data + pos + sizeof(record), record.m_size, m_frame.data(), m_frame.size(), record.m_flags & ShowRecordHeader::KEYFRAME);
+}
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace icosahedron {
+
+/// What each frame of a show file holds.
+enum class ShowFrameKind : uint32_t {
+  /// The lights before mapping, 8 bit planes of red, green and blue as QuantiseLights() writes them.
+  Lights = 0,
+  /// Every host's universes from the mapping file, 512 slots each, as they were sent.
+  Packets = 1
+};
+
+/// Header at the start of a show file, followed by m_layoutSize bytes of layout text and then the
+/// frames. Everything is in the byte order of the machine that wrote it.
+///
+/// Each frame is a ShowRecordHeader and its data, which is the difference from the frame before
+/// run length encoded by EncodeFrameDelta(). Every m_keyframeInterval frames there is a keyframe,
+/// which is encoded on its own, so any frame can be decoded from the keyframe before it. The file
+/// is only ever appended to while recording. When the recording is finished the offset of every
+/// frame is appended as the index, followed by a ShowFileFooter. A file without the footer, such
+/// as one still being recorded, is read by walking the frames instead.
+struct ShowFileHeader {
+  static constexpr char MAGIC[8] = {'N', 'L', 'S', 'H', 'O', 'W', 0, 0};
+  static const uint32_t VERSION = 1;
+
+  char m_magic[8];
+  uint32_t m_version = VERSION;
+  uint32_t m_kind = 0;
+  /// Frames per second the show was recorded at.
+  uint32_t m_frameRate = 0;
+  /// Bytes in each decoded frame.
+  uint32_t m_frameSize = 0;
+  uint32_t m_keyframeInterval = 0;
+  /// For light frames the number of lights, for packet frames the hosts from the mapping file,
+  /// which must match when the show is played back.
+  uint32_t m_layoutSize = 0;
+};
+
+struct ShowRecordHeader {
+  static const uint32_t KEYFRAME = 1;
+
+  /// Bytes of encoded data following the header.
+  uint32_t m_size = 0;
+  uint32_t m_flags = 0;
+};
+
+struct ShowFileFooter {
+  static constexpr char MAGIC[8] = {'N', 'L', 'S', 'I', 'N', 'D', 'E', 'X'};
+
+  /// Where the index is, which has m_numFrames 64 bit offsets of the frames' record headers.
+  uint64_t m_indexOffset = 0;
+  uint64_t m_numFrames = 0;
+  char m_magic[8];
+};
+
+/// Appends the run length encoding of the difference between frame and prev, or of frame itself
+/// when prev is null, to out. Unchanged parts of the frame become runs of zeros.
+void EncodeFrameDelta(const uint8_t *frame, const uint8_t *prev, size_t size, std::vector<uint8_t>& out);
+
+/// Applies encoded data from EncodeFrameDelta() to frame, which must hold the previous frame
+/// unless it is a keyframe. Runs of zeros skip over the unchanged bytes without touching them.
+/// Returns false if the data is corrupt.
+bool DecodeFrameDelta(const uint8_t *data, size_t dataSize, uint8_t *frame, size_t size, bool keyframe);
+
+/// Records frames into a show file.
+class ShowWriter {
+public:
+  ~ShowWriter() { close(); }
+
+  /// Creates filename for frames of frameSize bytes. A keyframe interval of 0 puts one every two
+  /// seconds.
+  bool open(const std::string& filename, ShowFrameKind kind, int frameRate, size_t frameSize, const std::string& layout, int keyframeInterval = 0);
+
+  /// Writes the index and closes the file. Returns false if any of the writes failed.
+  bool close();
+
+  bool isOpen() const { return m_file != nullptr; }
+
+  /// Appends a frame of the size given to open(). Each frame is flushed so the file can be
+  /// played while it is being recorded.
+  bool write(const uint8_t *frame);
+
+  size_t numFrames() const { return m_index.size(); }
+
+private:
+  FILE *m_file = nullptr;
+  ShowFileHeader m_header;
+  uint64_t m_offset = 0;
+  std::vector<uint64_t> m_index;
+  std::vector<uint8_t> m_prev;
+  std::vector<uint8_t> m_encoded;
+  bool m_failed = false;
+};
+
+/// Plays a show file, which is mapped into memory rather than read so that a long show costs no
+/// more than the frames being decoded.
+class ShowReader {
+public:
+  ~ShowReader() { close(); }
+
+  bool open(const std::string& filename);
+  void close();
+
+  const ShowFileHeader& header() const { return m_header; }
+  ShowFrameKind kind() const { return ShowFrameKind(m_header.m_kind); }
+  const std::string& layout() const { return m_layout; }
+  size_t numFrames() const { return m_index.size(); }
+  size_t frameSize() const { return m_header.m_frameSize; }
+
+  /// Decodes frame n, returning null if it is corrupt. The frame is valid until the next call.
+  /// The next frame costs one decode, any other the decodes from the keyframe before it.
+  const uint8_t *frame(size_t n);
+
+private:
+  /// Applies frame n's record to m_frame.
+  bool decode(size_t n);
+
+  const uint8_t *m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  std::vector<uint8_t> m_contents;
+#endif
+
+  ShowFileHeader m_header;
+  std::string m_layout;
+  std::vector<uint64_t> m_index;
+
+  std::vector<uint8_t> m_frame;
+  /// The frame in m_frame, or -1.
+  long m_decoded = -1;
+};
+
+}
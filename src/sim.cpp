@@ -0,0 +1,807 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <queue>
+#include <algorithm>
+
+#include <e131.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include <glm/glm.hpp>
+
+#include "icosahedron.hpp"
+#include "colourcorrection.hpp"
+#include "network.hpp"
+#include "artnet.hpp"
+#include "ddp.hpp"
+#include "pacer.hpp"
+
+// Simulates the rig's controllers on this machine, so the senders can be checked without the
+// hardware. Each host in the mapping file gets a socket on its own address, which receives its
+// universes, rebuilds its LED buffer like WLED would and maps it back to the lights with the
+// inverse of the ranges. At the end it reports each host's frame rate, packet loss, reordering
+// and latency.
+//
+// nice-lights-sim [options] mapping-file
+//
+//   --loopback        bind the hosts to 127.0.1.n instead of their own addresses, otherwise those
+//                     need adding to the loopback interface (ip addr add 192.168.128.101/32 dev lo)
+//   --drive rate      send a test pattern to the hosts from this process at rate frames a second,
+//                     which gives the end to end latency and checks the lights arrive in the right
+//                     places. Without it nice-lights or another sender drives the hosts.
+//   --pace fraction   pace the test pattern's packets over this fraction of the frame interval
+//   --no-sync         don't use the sync universe from the mapping file
+//   --seconds n       how long to run, 10 by default
+//   --offset n        packet start offset the controllers use, 1 like WLED by default
+//   --loss percent    drop this percentage of packets
+//   --delay ms        delay every packet by this long
+//   --jitter ms       delay every packet by up to this much more, which reorders them
+//   --reorder percent hold this percentage of packets back by 2ms so they arrive out of order
+//   --capacity n      packets each controller can have waiting, any more are dropped as overruns
+//   --service us      time each controller takes to handle a packet, with --capacity this models
+//                     an ESP32 that can't keep up with a burst
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+  std::string m_mappingFile;
+  bool m_loopback = false;
+  float m_driveRate = 0.0f;
+  float m_pace = 0.0f;
+  bool m_sync = true;
+  float m_seconds = 10.0f;
+  int m_offset = 1;
+  float m_loss = 0.0f;
+  float m_delayMs = 0.0f;
+  float m_jitterMs = 0.0f;
+  float m_reorder = 0.0f;
+  int m_capacity = 0;
+  float m_serviceUs = 0.0f;
+};
+
+/// Lights in each universe, as the senders pack them.
+const int UNIVERSE_LEDS = (sizeof(((e131_packet_t *)0)->dmp.prop_val) - 1) / 3;
+
+/// How long a reordered packet is held back.
+const std::chrono::microseconds REORDER_HOLD(2000);
+
+/// The mapping file read the same way the sender reads it, with access to the hosts.
+class Mapping : public NetworkMultiSender {
+public:
+  using NetworkMultiSender::DeviceLEDRange;
+  using NetworkMultiSender::HostDef;
+
+  const std::vector<HostDef>& hosts() const { return m_hosts; }
+};
+
+/// Tracks a stream of sequence numbers that count from first and wrap after period values.
+struct SequenceTracker {
+  int m_last = -1;
+
+  /// Counts the packets skipped over and reordered. A packet that was counted as lost when it was
+  /// skipped over and then turns up late counts as reordered instead.
+  void update(int seq, int first, int period, long& lost, long& reordered, long& duplicate) {
+    if(seq < first)
+      return;
+    if(m_last < 0) {
+      m_last = seq;
+      return;
+    }
+    int diff = ((seq - m_last) % period + period) % period;
+    if(diff > period / 2)
+      diff -= period;
+    if(diff == 0) {
+      duplicate++;
+    } else if(diff < 0) {
+      reordered++;
+      if(lost > 0)
+	lost--;
+    } else {
+      lost += diff - 1;
+      m_last = seq;
+    }
+  }
+};
+
+/// One host line of the mapping file, as its controller sees it.
+struct SimHost {
+  std::string m_name;
+  Protocol m_protocol = Protocol::E131;
+  int m_startUniverse = 0;
+  int m_numLEDs = 0;
+  int m_numUniverses = 0;
+  std::vector<Mapping::DeviceLEDRange> m_ranges;
+
+  /// The controller's LED buffer, 3 bytes to an LED.
+  std::vector<uint8_t> m_leds;
+  /// The universes, or for DDP the packets, received for the frame being assembled.
+  std::vector<bool> m_received;
+  int m_numReceived = 0;
+  int m_numParts = 0;
+  bool m_assembling = false;
+  /// When the frame's first and newest packets came off the network, before any injected delay.
+  /// The newest says which frame it is.
+  Clock::time_point m_firstArrival;
+  Clock::time_point m_lastArrival;
+  bool m_syncMode = false;
+  Clock::time_point m_lastSync;
+  std::vector<SequenceTracker> m_sequences;
+
+  long m_packets = 0;
+  long m_frames = 0;
+  long m_partial = 0;
+  long m_lost = 0;
+  long m_reordered = 0;
+  long m_duplicate = 0;
+  long m_dropped = 0;
+  long m_overrun = 0;
+  long m_badLights = 0;
+  std::vector<double> m_latencies;
+};
+
+/// A socket that receives for all the hosts on one address and port, like one controller.
+struct SimController {
+  std::string m_address;
+  uint16_t m_port = 0;
+  Protocol m_protocol = Protocol::E131;
+  int m_fd = -1;
+  std::vector<int> m_hosts;
+  /// Packets waiting to be handled and when the last of them will have been.
+  int m_queued = 0;
+  Clock::time_point m_busyUntil;
+};
+
+/// A packet on its way to a controller.
+struct Delivery {
+  Clock::time_point m_time;
+  uint64_t m_order;
+  /// Is true once the packet is in the controller's queue, and m_time is when it's handled.
+  bool m_queued;
+  int m_controller;
+  int m_host;
+  Clock::time_point m_arrival;
+  std::vector<uint8_t> m_data;
+
+  bool operator>(const Delivery& other) const {
+    return m_time > other.m_time || (m_time == other.m_time && m_order > other.m_order);
+  }
+};
+
+/// The test pattern, every seventh light is on and they move along one each frame.
+bool PatternOn(int light, long frame)
+{
+  return (light + frame) % 7 == 0;
+}
+
+std::string BaseAddress(const std::string& name)
+{
+  return name.substr(0, name.find('-'));
+}
+
+uint16_t ProtocolPort(Protocol protocol)
+{
+  switch(protocol) {
+  case Protocol::E131:
+    return E131_DEFAULT_PORT;
+  case Protocol::ArtNet:
+    return ARTNET_PORT;
+  case Protocol::DDP:
+    return DDP_PORT;
+  }
+  return 0;
+}
+
+/// Sends the test pattern to the hosts at a fixed rate and remembers when each frame started.
+class Driver {
+public:
+  ~Driver() { stop(); }
+
+  bool start(const std::string& mapping, const Options& options) {
+    std::istringstream input(mapping);
+    if(!m_sender.readRanges(input))
+      return false;
+    int numLights = 0;
+    for(const auto& host : m_sender.hosts()) {
+      for(const auto& range : host.m_ranges)
+	numLights = std::max(numLights, range.m_srcEnd);
+    }
+    m_lights.resize(numLights);
+    m_sender.m_frameDivisor = 1;
+    m_sender.m_sync = options.m_sync;
+    m_sender.m_pace = options.m_pace > 0.0f;
+    m_sender.m_paceFraction = options.m_pace;
+    m_sender.m_enabled = true;
+    m_sender.updateEnabled();
+    m_interval = std::chrono::nanoseconds(int64_t(1e9 / options.m_driveRate));
+    m_thread = std::thread([this]() { run(); });
+    return true;
+  }
+
+  void stop() {
+    m_quit = true;
+    if(m_thread.joinable())
+      m_thread.join();
+  }
+
+  /// The newest frame that started sending at or before when, -1 if there isn't one.
+  long frameAt(Clock::time_point when, Clock::time_point& started) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(long frame = long(m_started.size()) - 1; frame >= 0; frame--) {
+      if(m_started[frame] <= when) {
+	started = m_started[frame];
+	return frame;
+      }
+    }
+    return -1;
+  }
+
+  long framesSent() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_started.size();
+  }
+
+private:
+  void run() {
+    auto next = Clock::now();
+    for(long frame = 0; !m_quit; frame++) {
+      for(size_t n = 0; n<m_lights.size(); n++) {
+	const float value = PatternOn(n, frame) ? 1.0f : 0.0f;
+	m_lights.r()[n] = m_lights.g()[n] = m_lights.b()[n] = value;
+      }
+      {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_started.push_back(Clock::now());
+      }
+      m_sender.sendFrame(m_lights, m_interval);
+
+      next += m_interval;
+      const auto now = Clock::now();
+      if(next < now)
+	next = now;
+      SleepUntil(next);
+    }
+    m_sender.m_enabled = false;
+    m_sender.updateEnabled();
+  }
+
+  Mapping m_sender;
+  icosahedron::LightBuffer m_lights;
+  std::chrono::nanoseconds m_interval;
+  std::thread m_thread;
+  std::atomic<bool> m_quit{false};
+  std::mutex m_mutex;
+  std::vector<Clock::time_point> m_started;
+};
+
+class Simulator {
+public:
+  bool init(const Options& options);
+  void run();
+  void report();
+
+private:
+  /// Works out which of the controller's hosts a packet is for, -1 if none of them.
+  int findHost(const SimController& controller, const uint8_t *data, size_t length) const;
+  void receive(int controller, Clock::time_point now);
+  void deliver(Delivery& delivery);
+  void handlePacket(SimController& controller, int hostIdx, const Delivery& delivery);
+  void handleUniverse(SimHost& host, int universe, const uint8_t *data, int count, bool sync, const Delivery& delivery);
+  void handleSync(SimController& controller, const Delivery& delivery);
+  void finishFrame(SimHost& host, Clock::time_point when, bool partial);
+
+  Options m_options;
+  std::string m_mapping;
+  std::vector<SimHost> m_hosts;
+  std::vector<SimController> m_controllers;
+  std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery>> m_deliveries;
+  uint64_t m_order = 0;
+  std::mt19937 m_random{1};
+  std::unique_ptr<Driver> m_driver;
+  Clock::time_point m_start;
+};
+
+bool Simulator::init(const Options& options)
+{
+  m_options = options;
+
+  std::ifstream fi(options.m_mappingFile);
+  if(!fi) {
+    printf("Failed to open %s\n", options.m_mappingFile.c_str());
+    return false;
+  }
+  std::stringstream text;
+  text << fi.rdbuf();
+  m_mapping = text.str();
+
+  Mapping mapping;
+  {
+    std::istringstream input(m_mapping);
+    if(!mapping.readRanges(input))
+      return false;
+  }
+
+  // give each controller a loopback address, and point the mapping at them for the driver.
+  if(options.m_loopback) {
+    std::vector<std::string> addresses;
+    for(const auto& host : mapping.hosts()) {
+      if(std::find(addresses.begin(), addresses.end(), BaseAddress(host.m_ipAddr)) == addresses.end())
+	addresses.push_back(BaseAddress(host.m_ipAddr));
+    }
+    std::istringstream input(m_mapping);
+    std::string rewritten, line;
+    while(std::getline(input, line)) {
+      if(!line.empty() && line[0] != '#') {
+	std::istringstream words(line);
+	std::string word;
+	line.clear();
+	while(words >> word) {
+	  auto itr = std::find(addresses.begin(), addresses.end(), BaseAddress(word));
+	  if(itr != addresses.end())
+	    word = "127.0.1." + std::to_string(itr - addresses.begin() + 1) + word.substr(BaseAddress(word).size());
+	  line += (line.empty() ? "" : " ") + word;
+	}
+      }
+      rewritten += line + "\n";
+    }
+    m_mapping = rewritten;
+    std::istringstream remapped(m_mapping);
+    if(!mapping.readRanges(remapped))
+      return false;
+  }
+
+  for(const auto& def : mapping.hosts()) {
+    SimHost host;
+    host.m_name = def.m_ipAddr;
+    host.m_protocol = def.m_protocol;
+    host.m_startUniverse = def.m_startUniverse;
+    host.m_numLEDs = def.m_dataEnd;
+    host.m_numUniverses = (def.m_dataEnd / UNIVERSE_LEDS) + 1;
+    host.m_ranges = def.m_ranges;
+    host.m_leds.assign(def.m_dataEnd * 3, 0);
+    host.m_numParts = def.m_protocol == Protocol::DDP ? (def.m_dataEnd * 3 + DDP_MAX_DATA - 1) / DDP_MAX_DATA : host.m_numUniverses;
+    host.m_received.assign(host.m_numParts, false);
+    host.m_sequences.resize(def.m_protocol == Protocol::DDP ? 1 : host.m_numUniverses);
+
+    const std::string address = BaseAddress(def.m_ipAddr);
+    const uint16_t port = ProtocolPort(def.m_protocol);
+    auto itr = std::find_if(m_controllers.begin(), m_controllers.end(), [&](const SimController& controller) {
+      return controller.m_address == address && controller.m_port == port;
+    });
+    if(itr == m_controllers.end()) {
+      m_controllers.emplace_back();
+      itr = m_controllers.end() - 1;
+      itr->m_address = address;
+      itr->m_port = port;
+      itr->m_protocol = def.m_protocol;
+    }
+    itr->m_hosts.push_back(m_hosts.size());
+    m_hosts.push_back(host);
+  }
+
+  for(auto& controller : m_controllers) {
+    e131_addr_t addr;
+    if((controller.m_fd = e131_socket()) < 0 || e131_unicast_dest(&addr, controller.m_address.c_str(), controller.m_port) < 0) {
+      printf("Failed to create socket for %s\n", controller.m_address.c_str());
+      return false;
+    }
+    e131_recv_buffer(controller.m_fd, 8 * 1024 * 1024);
+#ifdef SO_TIMESTAMPNS
+    // have the kernel stamp when each packet arrived, so one read late isn't put down to the frame
+    // after it.
+    int on = 1;
+    setsockopt(controller.m_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+#endif
+    if(bind(controller.m_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      printf("Failed to bind %s:%i, add it to the loopback interface (ip addr add %s/32 dev lo) or use --loopback\n",
+	     controller.m_address.c_str(), controller.m_port, controller.m_address.c_str());
+      return false;
+    }
+    printf("Controller %s:%i, %s, %i hosts\n", controller.m_address.c_str(), controller.m_port,
+	   ProtocolName(controller.m_protocol), int(controller.m_hosts.size()));
+  }
+
+  if(options.m_driveRate > 0.0f)
+    m_driver.reset(new Driver);
+  return true;
+}
+
+void Simulator::run()
+{
+  std::vector<pollfd> fds;
+  for(const auto& controller : m_controllers)
+    fds.push_back({controller.m_fd, POLLIN, 0});
+
+  // started here rather than in init() so the first frames aren't read late and put down to the
+  // frames after them.
+  if(m_driver && !m_driver->start(m_mapping, m_options))
+    return;
+
+  m_start = Clock::now();
+  const auto end = m_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_options.m_seconds));
+  auto nextStatus = m_start + std::chrono::seconds(1);
+  for(;;) {
+    auto now = Clock::now();
+    if(now >= end)
+      break;
+
+    // wake for the next packet due out of the delay queue as well as for new ones, polling
+    // without waiting when it's due in under a millisecond.
+    auto wake = std::min(end, nextStatus);
+    if(!m_deliveries.empty())
+      wake = std::min(wake, m_deliveries.top().m_time);
+    const int timeoutMs = std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count());
+    if(poll(fds.data(), fds.size(), timeoutMs) > 0) {
+      now = Clock::now();
+      for(size_t n = 0; n<fds.size(); n++) {
+	if(fds[n].revents & POLLIN)
+	  receive(n, now);
+      }
+    }
+
+    now = Clock::now();
+    while(!m_deliveries.empty() && m_deliveries.top().m_time <= now) {
+      Delivery delivery = m_deliveries.top();
+      m_deliveries.pop();
+      deliver(delivery);
+    }
+
+    if(now >= nextStatus) {
+      long frames = 0, lost = 0, dropped = 0, overrun = 0;
+      for(const auto& host : m_hosts) {
+	frames += host.m_frames;
+	lost += host.m_lost;
+	dropped += host.m_dropped;
+	overrun += host.m_overrun;
+      }
+      printf("%5.1fs: frames %li, lost %li, dropped %li, overrun %li\n",
+	     std::chrono::duration<double>(now - m_start).count(), frames, lost, dropped, overrun);
+      nextStatus += std::chrono::seconds(1);
+    }
+  }
+
+  if(m_driver)
+    m_driver->stop();
+}
+
+void Simulator::receive(int controllerIdx, Clock::time_point now)
+{
+  auto& controller = m_controllers[controllerIdx];
+  std::uniform_real_distribution<float> percent(0.0f, 100.0f);
+  std::uniform_real_distribution<float> jitter(0.0f, m_options.m_jitterMs);
+  uint8_t buf[2048];
+  char control[256];
+  for(;;) {
+    iovec iov = {buf, sizeof(buf)};
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    const ssize_t length = recvmsg(controller.m_fd, &msg, MSG_DONTWAIT);
+    if(length < 0)
+      return;
+
+    // the kernel's stamp is on the realtime clock, so take how long ago it was from now.
+    Clock::time_point arrival = now;
+#ifdef SO_TIMESTAMPNS
+    for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+	timespec stamp, realNow;
+	memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+	clock_gettime(CLOCK_REALTIME, &realNow);
+	const auto age = std::chrono::seconds(realNow.tv_sec - stamp.tv_sec) + std::chrono::nanoseconds(realNow.tv_nsec - stamp.tv_nsec);
+	arrival = Clock::now() - std::chrono::duration_cast<Clock::duration>(std::max(age, std::chrono::nanoseconds::zero()));
+      }
+    }
+#endif
+
+    const int host = findHost(controller, buf, length);
+    if(m_options.m_loss > 0.0f && percent(m_random) < m_options.m_loss) {
+      if(host >= 0)
+	m_hosts[host].m_dropped++;
+      continue;
+    }
+
+    auto delay = std::chrono::duration<float, std::milli>(m_options.m_delayMs + (m_options.m_jitterMs > 0.0f ? jitter(m_random) : 0.0f));
+    auto when = arrival + std::chrono::duration_cast<Clock::duration>(delay);
+    if(m_options.m_reorder > 0.0f && percent(m_random) < m_options.m_reorder)
+      when += REORDER_HOLD;
+    m_deliveries.push({when, m_order++, false, controllerIdx, host, arrival, std::vector<uint8_t>(buf, buf + length)});
+  }
+}
+
+void Simulator::deliver(Delivery& delivery)
+{
+  auto& controller = m_controllers[delivery.m_controller];
+  const bool modelled = m_options.m_capacity > 0 || m_options.m_serviceUs > 0.0f;
+  if(!modelled || delivery.m_queued) {
+    if(delivery.m_queued)
+      controller.m_queued--;
+    handlePacket(controller, delivery.m_host, delivery);
+    return;
+  }
+
+  // the controller's receive buffer, which overruns when packets come faster than it handles them.
+  if(m_options.m_capacity > 0 && controller.m_queued >= m_options.m_capacity) {
+    if(delivery.m_host >= 0)
+      m_hosts[delivery.m_host].m_overrun++;
+    return;
+  }
+  controller.m_queued++;
+  controller.m_busyUntil = std::max(controller.m_busyUntil, delivery.m_time) +
+    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::micro>(m_options.m_serviceUs));
+  delivery.m_time = controller.m_busyUntil;
+  delivery.m_queued = true;
+  m_deliveries.push(delivery);
+}
+
+int Simulator::findHost(const SimController& controller, const uint8_t *data, size_t length) const
+{
+  int universe = -1;
+  switch(controller.m_protocol) {
+  case Protocol::E131:
+    if(length >= sizeof(e131_packet_t) - sizeof(((e131_packet_t *)0)->dmp.prop_val))
+      universe = ntohs(reinterpret_cast<const e131_packet_t *>(data)->frame.universe);
+    break;
+  case Protocol::ArtNet:
+    if(length >= sizeof(artnet_dmx_packet_t) - sizeof(artnet_dmx_packet_t::data)) {
+      const auto& packet = *reinterpret_cast<const artnet_dmx_packet_t *>(data);
+      universe = ((packet.net & 0x7f) << 8) | packet.sub_uni;
+    }
+    break;
+  case Protocol::DDP:
+    // one host to a DDP controller.
+    return controller.m_hosts[0];
+  }
+
+  for(const int idx : controller.m_hosts) {
+    const auto& host = m_hosts[idx];
+    if(universe >= host.m_startUniverse && universe < host.m_startUniverse + host.m_numUniverses)
+      return idx;
+  }
+  return -1;
+}
+
+void Simulator::handlePacket(SimController& controller, int hostIdx, const Delivery& delivery)
+{
+  const uint8_t *data = delivery.m_data.data();
+  const size_t length = delivery.m_data.size();
+
+  switch(controller.m_protocol) {
+  case Protocol::E131: {
+    if(length == sizeof(e131_sync_packet_t)) {
+      const auto& sync = *reinterpret_cast<const e131_sync_packet_t *>(data);
+      if(ntohl(sync.frame.vector) == 1)
+	handleSync(controller, delivery);
+      return;
+    }
+    e131_packet_t packet;
+    memset(&packet, 0, sizeof(packet));
+    memcpy(&packet, data, std::min(length, sizeof(packet)));
+    if(e131_pkt_validate(&packet) != E131_ERR_NONE || length < e131_pkt_length(&packet) || hostIdx < 0)
+      return;
+    auto& host = m_hosts[hostIdx];
+    const int universe = ntohs(packet.frame.universe) - host.m_startUniverse;
+    host.m_sequences[universe].update(packet.frame.seq_number, 0, 256, host.m_lost, host.m_reordered, host.m_duplicate);
+    const int offset = std::max(m_options.m_offset, 0);
+    handleUniverse(host, universe, packet.dmp.prop_val + offset, int(ntohs(packet.dmp.prop_val_cnt)) - offset,
+		   packet.frame.sync_universe != 0, delivery);
+    break;
+  }
+  case Protocol::ArtNet: {
+    const auto& syncPacket = *reinterpret_cast<const artnet_sync_packet_t *>(data);
+    if(length >= sizeof(artnet_sync_packet_t) && syncPacket.opcode_hi == 0x52 && syncPacket.opcode_lo == 0) {
+      handleSync(controller, delivery);
+      return;
+    }
+    const auto& packet = *reinterpret_cast<const artnet_dmx_packet_t *>(data);
+    const size_t headerSize = sizeof(artnet_dmx_packet_t) - sizeof(artnet_dmx_packet_t::data);
+    if(length < headerSize || packet.opcode_hi != 0x50 || packet.opcode_lo != 0 || hostIdx < 0)
+      return;
+    auto& host = m_hosts[hostIdx];
+    const int universe = (((packet.net & 0x7f) << 8) | packet.sub_uni) - host.m_startUniverse;
+    host.m_sequences[universe].update(packet.sequence, 1, 255, host.m_lost, host.m_reordered, host.m_duplicate);
+    // Art-Net nodes stay in sync mode until they've gone 4 seconds without an ArtSync.
+    const bool sync = host.m_syncMode && delivery.m_time - host.m_lastSync < std::chrono::seconds(4);
+    const int offset = std::max(m_options.m_offset - 1, 0);
+    const int count = std::min<int>((packet.length_hi << 8) | packet.length_lo, length - headerSize) - offset;
+    handleUniverse(host, universe, packet.data + offset, count, sync, delivery);
+    break;
+  }
+  case Protocol::DDP: {
+    const auto& packet = *reinterpret_cast<const ddp_packet_t *>(data);
+    const size_t headerSize = sizeof(ddp_packet_t::raw) - DDP_MAX_DATA;
+    if(length < headerSize || hostIdx < 0)
+      return;
+    auto& host = m_hosts[hostIdx];
+    host.m_packets++;
+    host.m_sequences[0].update(packet.sequence & 0x0f, 1, 15, host.m_lost, host.m_reordered, host.m_duplicate);
+
+    const size_t offset = ntohl(packet.offset);
+    const size_t count = std::min<size_t>(ntohs(packet.length), length - headerSize);
+    const size_t part = offset / DDP_MAX_DATA;
+    if(count && part < host.m_received.size()) {
+      // a packet that has already arrived means the push for the last frame never did.
+      if(host.m_received[part])
+	finishFrame(host, delivery.m_time, true);
+      if(!host.m_assembling) {
+	host.m_assembling = true;
+	host.m_firstArrival = delivery.m_arrival;
+      }
+      host.m_lastArrival = delivery.m_arrival;
+      if(offset < host.m_leds.size())
+	memcpy(&host.m_leds[offset], packet.data, std::min(count, host.m_leds.size() - offset));
+      host.m_received[part] = true;
+      host.m_numReceived++;
+    }
+    if(packet.flags & 0x01)
+      finishFrame(host, delivery.m_time, host.m_numReceived < host.m_numParts);
+    break;
+  }
+  }
+}
+
+void Simulator::handleUniverse(SimHost& host, int universe, const uint8_t *data, int count, bool sync, const Delivery& delivery)
+{
+  host.m_packets++;
+  host.m_syncMode = sync;
+
+  // a universe that has already arrived means the end of the last frame never did.
+  if(host.m_received[universe])
+    finishFrame(host, delivery.m_time, true);
+  if(!host.m_assembling) {
+    host.m_assembling = true;
+    host.m_firstArrival = delivery.m_arrival;
+  }
+  host.m_lastArrival = delivery.m_arrival;
+  host.m_received[universe] = true;
+  host.m_numReceived++;
+
+  const int first = universe * UNIVERSE_LEDS * 3;
+  count = std::min(count, std::min<int>(UNIVERSE_LEDS * 3, host.m_leds.size() - first));
+  if(count > 0)
+    memcpy(&host.m_leds[first], data, count);
+
+  // like WLED, without sync the frame is shown when its last universe arrives.
+  if(!sync && universe == host.m_numParts - 1)
+    finishFrame(host, delivery.m_time, host.m_numReceived < host.m_numParts);
+}
+
+void Simulator::handleSync(SimController& controller, const Delivery& delivery)
+{
+  for(const int idx : controller.m_hosts) {
+    auto& host = m_hosts[idx];
+    host.m_syncMode = true;
+    host.m_lastSync = delivery.m_time;
+    if(host.m_assembling)
+      finishFrame(host, delivery.m_time, host.m_numReceived < host.m_numParts);
+  }
+}
+
+void Simulator::finishFrame(SimHost& host, Clock::time_point when, bool partial)
+{
+  if(!host.m_assembling)
+    return;
+  host.m_assembling = false;
+  std::fill(host.m_received.begin(), host.m_received.end(), false);
+  host.m_numReceived = 0;
+
+  if(partial) {
+    host.m_partial++;
+    return;
+  }
+  host.m_frames++;
+
+  if(!m_driver) {
+    // no send times, so the best there is is how long the frame took to arrive.
+    host.m_latencies.push_back(std::chrono::duration<double, std::milli>(when - host.m_firstArrival).count());
+    return;
+  }
+
+  Clock::time_point started;
+  const long frame = m_driver->frameAt(host.m_lastArrival, started);
+  if(frame < 0)
+    return;
+  host.m_latencies.push_back(std::chrono::duration<double, std::milli>(when - started).count());
+
+  // map the LEDs back to the lights with the inverse of the ranges and check the pattern.
+  for(const auto& range : host.m_ranges) {
+    for(int idx = range.m_srcStart; idx<range.m_srcEnd; idx++) {
+      const int led = range.m_destOffset + (range.m_reversed ? range.m_srcEnd - 1 - idx : idx - range.m_srcStart);
+      const uint8_t *rgb = &host.m_leds[led * 3];
+      const bool on = rgb[0] || rgb[1] || rgb[2];
+      if(on != PatternOn(idx, frame))
+	host.m_badLights++;
+    }
+  }
+}
+
+void Simulator::report()
+{
+  const double seconds = std::chrono::duration<double>(Clock::now() - m_start).count();
+  printf("\n%-20s %-6s %7s %8s %7s %7s %6s %6s %6s %6s %6s %7s %9s %9s\n", "host", "proto", "fps", "packets", "frames", "partial",
+	 "lost", "reord", "dup", "drop", "overrun", "bad", m_driver ? "lat50 ms" : "span50 ms", m_driver ? "lat99 ms" : "span99 ms");
+  for(auto& host : m_hosts) {
+    auto& latencies = host.m_latencies;
+    std::sort(latencies.begin(), latencies.end());
+    const double p50 = latencies.empty() ? 0.0 : latencies[latencies.size() / 2];
+    const double p99 = latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    printf("%-20s %-6s %7.1f %8li %7li %7li %6li %6li %6li %6li %6li %7li %9.3f %9.3f\n", host.m_name.c_str(), ProtocolName(host.m_protocol),
+	   host.m_frames / seconds, host.m_packets, host.m_frames, host.m_partial, host.m_lost, host.m_reordered, host.m_duplicate,
+	   host.m_dropped, host.m_overrun, host.m_badLights, p50, p99);
+  }
+  if(m_driver)
+    printf("%li frames sent\n", m_driver->framesSent());
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  Options options;
+  for(int n = 1; n<argc; n++) {
+    const std::string arg = argv[n];
+    auto value = [&]() -> const char * {
+      if(n + 1 >= argc) {
+	printf("%s needs a value\n", arg.c_str());
+	exit(1);
+      }
+      return argv[++n];
+    };
+    if(arg == "--loopback")
+      options.m_loopback = true;
+    else if(arg == "--drive")
+      options.m_driveRate = atof(value());
+    else if(arg == "--pace")
+      options.m_pace = atof(value());
+    else if(arg == "--no-sync")
+      options.m_sync = false;
+    else if(arg == "--seconds")
+      options.m_seconds = atof(value());
+    else if(arg == "--offset")
+      options.m_offset = atoi(value());
+    else if(arg == "--loss")
+      options.m_loss = atof(value());
+    else if(arg == "--delay")
+      options.m_delayMs = atof(value());
+    else if(arg == "--jitter")
+      options.m_jitterMs = atof(value());
+    else if(arg == "--reorder")
+      options.m_reorder = atof(value());
+    else if(arg == "--capacity")
+      options.m_capacity = atoi(value());
+    else if(arg == "--service")
+      options.m_serviceUs = atof(value());
+    else if(arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+      printf("Unknown option %s\n", arg.c_str());
+      return 1;
+    } else
+      options.m_mappingFile = arg;
+  }
+  if(options.m_mappingFile.empty()) {
+    printf("usage: nice-lights-sim [options] mapping-file\n");
+    return 1;
+  }
+
+  Simulator sim;
+  if(!sim.init(options))
+    return 1;
+  sim.run();
+  sim.report();
+  return 0;
+}
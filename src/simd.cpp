@@ -0,0 +1,57 @@
+#include <atomic>
+
+#include "simd.hpp"
+
+namespace icosahedron
+{
+
+SimdLevel GetSupportedSimdLevel()
+{
+  static const SimdLevel supported = []() {
+#ifdef NICE_LIGHTS_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+      return SimdLevel::AVX512;
+    if(__builtin_cpu_supports("avx2"))
+      return SimdLevel::AVX2;
+    if(__builtin_cpu_supports("sse2"))
+      return SimdLevel::SSE2;
+#endif
+    return SimdLevel::Scalar;
+  }();
+  return supported;
+}
+
+static std::atomic<int> g_simdLevel{-1};
+
+SimdLevel GetSimdLevel()
+{
+  int level = g_simdLevel.load(std::memory_order_relaxed);
+  if(level < 0)
+    return GetSupportedSimdLevel();
+  return SimdLevel(level);
+}
+
+void SetSimdLevel(SimdLevel level)
+{
+  if(int(level) > int(GetSupportedSimdLevel()))
+    level = GetSupportedSimdLevel();
+  g_simdLevel.store(int(level), std::memory_order_relaxed);
+}
+
+const char *GetSimdLevelName(SimdLevel level)
+{
+  switch(level) {
+  case SimdLevel::Scalar:
+    return "scalar";
+  case SimdLevel::SSE2:
+    return "sse2";
+  case SimdLevel::AVX2:
+    return "avx2";
+  case SimdLevel::AVX512:
+    return "avx512";
+  }
+  return "unknown";
+}
+
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// x86 SIMD kernels are only built with GCC compatible compilers where the per function target
+// attribute lets one binary carry several instruction sets; everything else uses the scalar paths.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NICE_LIGHTS_X86_SIMD 1
+#endif
+
+namespace icosahedron {
+
+/// Instruction sets that the batch kernels have implementations for, in increasing order.
+enum class SimdLevel {
+  Scalar,
+  SSE2,
+  AVX2,
+  AVX512
+};
+
+/// Returns the best instruction set the CPU supports.
+SimdLevel GetSupportedSimdLevel();
+
+/// Returns the instruction set the batch kernels are currently using.
+SimdLevel GetSimdLevel();
+
+/// Restricts the batch kernels to the given level (clamped to what the CPU supports). This is
+/// only meant for benchmarking and for checking the paths against each other.
+void SetSimdLevel(SimdLevel level);
+
+const char *GetSimdLevelName(SimdLevel level);
+
+}
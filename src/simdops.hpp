@@ -0,0 +1,155 @@
+#pragma once
+
+// Thin wrappers over each instruction set so the batch kernels can be written once and included
+// into each of these namespaces (see colourkernels.inl). Every namespace provides the same
+// operations with the same rounding and min/max semantics.
+//
+// Files that include the kernels must be built with -ffp-contract=off, see CMakeLists.txt.
+
+#include <cmath>
+#include <cstdint>
+
+#include "simd.hpp"
+
+#ifdef NICE_LIGHTS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace icosahedron {
+
+namespace simd_scalar {
+
+typedef float V;
+const int WIDTH = 1;
+
+static inline V Load(const float *p) { return *p; }
+static inline void Store(float *p, V v) { *p = v; }
+static inline V Set1(float f) { return f; }
+static inline V Add(V a, V b) { return a + b; }
+static inline V Sub(V a, V b) { return a - b; }
+static inline V Mul(V a, V b) { return a * b; }
+static inline V Div(V a, V b) { return a / b; }
+// these match the SSE min/max instructions, which return the second operand when equal.
+static inline V Min(V a, V b) { return a < b ? a : b; }
+static inline V Max(V a, V b) { return a > b ? a : b; }
+static inline V Floor(V a) { return std::floor(a); }
+static inline V Abs(V a) { return std::fabs(a); }
+/// Like GLSL step(), 0 where x < edge otherwise 1.
+static inline V Step(V edge, V x) { return x < edge ? 0.0f : 1.0f; }
+static inline V Gather(const float *base, V idx) { return base[int(idx)]; }
+
+}
+
+#ifdef NICE_LIGHTS_X86_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+namespace simd_sse2 {
+
+typedef __m128 V;
+const int WIDTH = 4;
+
+static inline V Load(const float *p) { return _mm_loadu_ps(p); }
+static inline void Store(float *p, V v) { _mm_storeu_ps(p, v); }
+static inline V Set1(float f) { return _mm_set1_ps(f); }
+static inline V Add(V a, V b) { return _mm_add_ps(a, b); }
+static inline V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+static inline V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+static inline V Div(V a, V b) { return _mm_div_ps(a, b); }
+static inline V Min(V a, V b) { return _mm_min_ps(a, b); }
+static inline V Max(V a, V b) { return _mm_max_ps(a, b); }
+
+// SSE2 has no rounding instruction so go through a truncating integer conversion.
+static inline V Floor(V a)
+{
+  const V signMask = _mm_set1_ps(-0.0f);
+  V t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+  V fl = _mm_sub_ps(t, _mm_and_ps(_mm_cmplt_ps(a, t), _mm_set1_ps(1.0f)));
+  // keep the sign of -0.0 like floor() does.
+  fl = _mm_or_ps(fl, _mm_and_ps(_mm_and_ps(a, signMask), _mm_cmpeq_ps(fl, _mm_setzero_ps())));
+  // anything this big is already whole and may not fit in an int.
+  V big = _mm_cmpge_ps(_mm_andnot_ps(signMask, a), _mm_set1_ps(8388608.0f));
+  return _mm_or_ps(_mm_and_ps(big, a), _mm_andnot_ps(big, fl));
+}
+
+static inline V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline V Step(V edge, V x) { return _mm_andnot_ps(_mm_cmplt_ps(x, edge), _mm_set1_ps(1.0f)); }
+
+static inline V Gather(const float *base, V idx)
+{
+  alignas(16) int32_t i[4];
+  _mm_store_si128((__m128i *)i, _mm_cvttps_epi32(idx));
+  return _mm_set_ps(base[i[3]], base[i[2]], base[i[1]], base[i[0]]);
+}
+
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace simd_avx2 {
+
+typedef __m256 V;
+const int WIDTH = 8;
+
+static inline V Load(const float *p) { return _mm256_loadu_ps(p); }
+static inline void Store(float *p, V v) { _mm256_storeu_ps(p, v); }
+static inline V Set1(float f) { return _mm256_set1_ps(f); }
+static inline V Add(V a, V b) { return _mm256_add_ps(a, b); }
+static inline V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+static inline V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+static inline V Div(V a, V b) { return _mm256_div_ps(a, b); }
+static inline V Min(V a, V b) { return _mm256_min_ps(a, b); }
+static inline V Max(V a, V b) { return _mm256_max_ps(a, b); }
+static inline V Floor(V a) { return _mm256_floor_ps(a); }
+static inline V Abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline V Step(V edge, V x) { return _mm256_andnot_ps(_mm256_cmp_ps(x, edge, _CMP_LT_OQ), _mm256_set1_ps(1.0f)); }
+static inline V Gather(const float *base, V idx) { return _mm256_i32gather_ps(base, _mm256_cvttps_epi32(idx), 4); }
+
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace simd_avx512 {
+
+typedef __m512 V;
+const int WIDTH = 16;
+
+static inline V Load(const float *p) { return _mm512_loadu_ps(p); }
+static inline void Store(float *p, V v) { _mm512_storeu_ps(p, v); }
+static inline V Set1(float f) { return _mm512_set1_ps(f); }
+static inline V Add(V a, V b) { return _mm512_add_ps(a, b); }
+static inline V Sub(V a, V b) { return _mm512_sub_ps(a, b); }
+static inline V Mul(V a, V b) { return _mm512_mul_ps(a, b); }
+static inline V Div(V a, V b) { return _mm512_div_ps(a, b); }
+static inline V Min(V a, V b) { return _mm512_min_ps(a, b); }
+static inline V Max(V a, V b) { return _mm512_max_ps(a, b); }
+static inline V Floor(V a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+static inline V Abs(V a) { return _mm512_abs_ps(a); }
+static inline V Step(V edge, V x) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, edge, _CMP_LT_OQ), _mm512_set1_ps(1.0f), _mm512_setzero_ps()); }
+static inline V Gather(const float *base, V idx) { return _mm512_i32gather_ps(_mm512_cvttps_epi32(idx), base, 4); }
+
+}
+#pragma GCC pop_options
+
+#endif
+
+}
+
+// Picks the widest implementation of a Run kernel for the current SIMD level, the
+// kernels must have been included into each instruction set namespace. Evaluates to the
+// number of elements it converted.
+#ifdef NICE_LIGHTS_X86_SIMD
+#define DISPATCH_RUN(kernel, ...)					\
+  [&]() -> int {							\
+    switch(GetSimdLevel()) {						\
+    case SimdLevel::AVX512: return simd_avx512::kernel(__VA_ARGS__);	\
+    case SimdLevel::AVX2: return simd_avx2::kernel(__VA_ARGS__);	\
+    case SimdLevel::SSE2: return simd_sse2::kernel(__VA_ARGS__);	\
+    default: return 0;							\
+    }									\
+  }()
+#else
+#define DISPATCH_RUN(kernel, ...) 0
+#endif
@@ -0,0 +1,190 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+#include "spatialgrid.hpp"
+
+namespace icosahedron
+{
+
+// Extra distance added to every query so that rounding in the cell arithmetic can never drop a
+// light that is right on the edge, as a fraction of the size of the whole grid.
+static const float QUERY_SLACK = 1e-4f;
+
+void SpatialGrid::build(const LightBuffer& positions, int lightsPerCell)
+{
+  const int count = positions.size();
+  const float *p[3] = {positions.x(), positions.y(), positions.z()};
+
+  m_lights.clear();
+  m_cellStart.clear();
+  for(int a = 0; a<3; a++)
+    m_dims[a] = 0;
+  if(count == 0)
+    return;
+
+  float extent[3];
+  float maxExtent = 0.0f;
+  for(int a = 0; a<3; a++) {
+    auto range = std::minmax_element(p[a], p[a] + count);
+    m_min[a] = *range.first;
+    extent[a] = *range.second - *range.first;
+    maxExtent = std::max(maxExtent, extent[a]);
+  }
+  // keep flat or single point rigs from giving zero sized cells.
+  maxExtent = std::max(maxExtent, 1e-6f);
+  for(int a = 0; a<3; a++)
+    extent[a] = std::max(extent[a], maxExtent * 1e-3f);
+
+  // pick a cube shaped cell that gives about the right number of cells over the bounding box.
+  const float cells = std::max(1.0f, float(count) / float(std::max(lightsPerCell, 1)));
+  const float side = std::cbrt((extent[0] * extent[1] * extent[2]) / cells);
+  for(int a = 0; a<3; a++) {
+    m_dims[a] = std::clamp(int(std::ceil(extent[a] / side)), 1, 1024);
+    m_cellSize[a] = extent[a] / float(m_dims[a]);
+  }
+
+  // counting sort of the lights into their cells, going through the lights in order keeps each
+  // cell's list in increasing order.
+  std::vector<int> lightCell(count);
+  m_cellStart.assign(m_dims[0] * m_dims[1] * m_dims[2] + 1, 0);
+  for(int n = 0; n<count; n++) {
+    int cell[3];
+    for(int a = 0; a<3; a++)
+      cell[a] = cellAlong(a, p[a][n]);
+    lightCell[n] = cellIndex(cell);
+    m_cellStart[lightCell[n] + 1]++;
+  }
+  for(size_t c = 1; c<m_cellStart.size(); c++)
+    m_cellStart[c] += m_cellStart[c - 1];
+
+  m_lights.resize(count);
+  std::vector<int> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+  for(int n = 0; n<count; n++)
+    m_lights[fill[lightCell[n]]++] = n;
+}
+
+int SpatialGrid::cellAlong(int axis, float v) const
+{
+  float c = std::floor((v - m_min[axis]) / m_cellSize[axis]);
+  // compare as floats first as anything far outside the grid may not fit in an int.
+  if(!(c > 0.0f))
+    return 0;
+  if(c >= float(m_dims[axis] - 1))
+    return m_dims[axis] - 1;
+  return int(c);
+}
+
+void SpatialGrid::appendRow(int axis, int cell[3], int from, int to, std::vector<int>& out) const
+{
+  for(cell[axis] = from; cell[axis]<=to; cell[axis]++) {
+    int c = cellIndex(cell);
+    out.insert(out.end(), m_lights.begin() + m_cellStart[c], m_lights.begin() + m_cellStart[c + 1]);
+  }
+}
+
+void SpatialGrid::queryPlane(const glm::vec3& normal, float offset, float dist, std::vector<int>& out) const
+{
+  if(m_lights.empty())
+    return;
+  const size_t first = out.size();
+
+  // walk the grid in columns along the axis the plane is most square on to, each column only
+  // crosses the slab for a short run of cells.
+  const float n[3] = {normal.x, normal.y, normal.z};
+  int a = 0;
+  for(int i = 1; i<3; i++)
+    if(std::fabs(n[i]) > std::fabs(n[a]))
+      a = i;
+  const int b = (a + 1) % 3;
+  const int c = (a + 2) % 3;
+
+  float slack = 0.0f;
+  for(int i = 0; i<3; i++)
+    slack += std::fabs(n[i]) * m_cellSize[i] * m_dims[i];
+  dist += slack * QUERY_SLACK;
+
+  if(n[a] == 0.0f) {
+    // no direction at all, so either everything is within dist or nothing is.
+    if(std::fabs(offset) < dist)
+      out.insert(out.end(), m_lights.begin(), m_lights.end());
+    return;
+  }
+
+  int cell[3];
+  for(cell[b] = 0; cell[b]<m_dims[b]; cell[b]++) {
+    const float b0 = m_min[b] + cell[b] * m_cellSize[b];
+    const float b1 = b0 + m_cellSize[b];
+    for(cell[c] = 0; cell[c]<m_dims[c]; cell[c]++) {
+      const float c0 = m_min[c] + cell[c] * m_cellSize[c];
+      const float c1 = c0 + m_cellSize[c];
+
+      // the range of the b and c part of the plane equation over the column, then solve for the
+      // range of a that puts the whole equation within dist.
+      const float lo = std::min(n[b] * b0, n[b] * b1) + std::min(n[c] * c0, n[c] * c1) + offset;
+      const float hi = std::max(n[b] * b0, n[b] * b1) + std::max(n[c] * c0, n[c] * c1) + offset;
+      float a0 = (-dist - hi) / n[a];
+      float a1 = (dist - lo) / n[a];
+      if(a0 > a1)
+	std::swap(a0, a1);
+
+      const float gridEnd = m_min[a] + m_cellSize[a] * m_dims[a];
+      if(a1 < m_min[a] || a0 > gridEnd)
+	continue;
+      appendRow(a, cell, cellAlong(a, a0), cellAlong(a, a1), out);
+    }
+  }
+
+  std::sort(out.begin() + first, out.end());
+}
+
+void SpatialGrid::querySphere(const glm::vec3& centre, float radius, std::vector<int>& out) const
+{
+  if(m_lights.empty())
+    return;
+  const size_t first = out.size();
+
+  const float q[3] = {centre.x, centre.y, centre.z};
+  float slack = 0.0f;
+  for(int i = 0; i<3; i++)
+    slack += m_cellSize[i] * m_dims[i];
+  radius += slack * QUERY_SLACK;
+
+  int from[3], to[3];
+  for(int a = 0; a<3; a++) {
+    const float gridEnd = m_min[a] + m_cellSize[a] * m_dims[a];
+    if(q[a] + radius < m_min[a] || q[a] - radius > gridEnd)
+      return;
+    from[a] = cellAlong(a, q[a] - radius);
+    to[a] = cellAlong(a, q[a] + radius);
+  }
+
+  // only take the cells where the nearest point of the cell is within the radius.
+  const auto AxisDistance = [&](int a, int i) -> float {
+    const float lo = m_min[a] + i * m_cellSize[a];
+    const float hi = lo + m_cellSize[a];
+    return q[a] < lo ? lo - q[a] : (q[a] > hi ? q[a] - hi : 0.0f);
+  };
+
+  int cell[3];
+  for(cell[2] = from[2]; cell[2]<=to[2]; cell[2]++) {
+    const float dz = AxisDistance(2, cell[2]);
+    for(cell[1] = from[1]; cell[1]<=to[1]; cell[1]++) {
+      const float dy = AxisDistance(1, cell[1]);
+      for(cell[0] = from[0]; cell[0]<=to[0]; cell[0]++) {
+	const float dx = AxisDistance(0, cell[0]);
+	if(dx * dx + dy * dy + dz * dz > radius * radius)
+	  continue;
+	int c = cellIndex(cell);
+	out.insert(out.end(), m_lights.begin() + m_cellStart[c], m_lights.begin() + m_cellStart[c + 1]);
+      }
+    }
+  }
+
+  std::sort(out.begin() + first, out.end());
+}
+
+}
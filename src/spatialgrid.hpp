@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+#include "lightbuffer.hpp"
+
+namespace icosahedron {
+
+/// A uniform grid over the light positions for finding the lights near a plane or a point
+/// without looking at all of them. The lights don't move so the grid is built once and then only
+/// read, which makes the queries safe to run from several threads.
+///
+/// The queries work a cell at a time, so they return every light that is in range and possibly
+/// some that are up to a cell further away. Callers still test each light they get back.
+class SpatialGrid {
+public:
+  /// Builds the grid with roughly lightsPerCell lights in each occupied cell.
+  void build(const LightBuffer& positions, int lightsPerCell = 8);
+
+  /// Number of lights the grid was built from.
+  int size() const { return m_lights.size(); }
+
+  /// Appends, in increasing order, the lights that could be within dist of the plane where
+  /// dot(normal, p) + offset is 0. The normal doesn't have to be unit length, in which case dist is
+  /// in the same units as dot(normal, p).
+  void queryPlane(const glm::vec3& normal, float offset, float dist, std::vector<int>& out) const;
+
+  /// Appends, in increasing order, the lights that could be within radius of centre.
+  void querySphere(const glm::vec3& centre, float radius, std::vector<int>& out) const;
+
+private:
+  int cellIndex(const int cell[3]) const { return (cell[2] * m_dims[1] + cell[1]) * m_dims[0] + cell[0]; }
+
+  /// Cell along axis that holds the coordinate v, clamped to the grid.
+  int cellAlong(int axis, float v) const;
+
+  /// Appends the lights in cells from to to inclusive of the row along axis through cell.
+  void appendRow(int axis, int cell[3], int from, int to, std::vector<int>& out) const;
+
+  float m_min[3] = {0.0f, 0.0f, 0.0f};
+  float m_cellSize[3] = {1.0f, 1.0f, 1.0f};
+  int m_dims[3] = {0, 0, 0};
+  /// Lights sorted by cell, the lights in cell c are m_lights[m_cellStart[c]] up to
+  /// m_lights[m_cellStart[c + 1]] and are in increasing order.
+  std::vector<int> m_cellStart;
+  std::vector<int> m_lights;
+};
+
+}
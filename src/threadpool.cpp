@@ -0,0 +1,155 @@
+#include <algorithm>
+
+#include "threadpool.hpp"
+
+namespace icosahedron
+{
+
+ThreadPool::ThreadPool(int nThreads)
+{
+  startWorkers(nThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+  stopWorkers();
+}
+
+void ThreadPool::setThreadCount(int nThreads)
+{
+  stopWorkers();
+  startWorkers(nThreads);
+}
+
+void ThreadPool::startWorkers(int nThreads)
+{
+  if(nThreads <= 0)
+    nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  m_quit = false;
+  m_queues.reset(new ChunkQueue[nThreads]);
+  for(int i = 1; i<nThreads; i++)
+    m_workers.emplace_back(&ThreadPool::workerMain, this, i, m_generation);
+}
+
+void ThreadPool::stopWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_all();
+  for(auto& worker : m_workers)
+    worker.join();
+  m_workers.clear();
+}
+
+void ThreadPool::parallelFor(int count, int grain, const RangeCallback& fn)
+{
+  if(count <= 0)
+    return;
+  grain = std::max(grain, 1);
+  const int nChunks = (count + grain - 1) / grain;
+  const int nThreads = threadCount();
+
+  // not worth waking anyone up for.
+  if(nChunks == 1 || nThreads == 1) {
+    for(int begin = 0; begin<count; begin += grain)
+      fn(begin, std::min(begin + grain, count));
+    return;
+  }
+
+  // deal out the chunks evenly, the first few threads get one extra when it doesn't divide.
+  for(int i = 0, chunk = 0; i<nThreads; i++) {
+    int n = nChunks / nThreads + (i < nChunks % nThreads ? 1 : 0);
+    m_queues[i].m_range.store(Pack(chunk, chunk + n), std::memory_order_relaxed);
+    chunk += n;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fn = &fn;
+    m_count = count;
+    m_grain = grain;
+    m_finished = 0;
+    m_generation++;
+  }
+  m_wake.notify_all();
+
+  runChunks(0);
+
+  // every worker has to have let go of fn before it goes out of scope, even the ones that woke
+  // too late to find anything left to do.
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this]() { return m_finished == int(m_workers.size()); });
+  m_fn = nullptr;
+}
+
+void ThreadPool::workerMain(int idx, uint64_t seenGeneration)
+{
+  for(;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&]() { return m_quit || m_generation != seenGeneration; });
+      if(m_quit)
+	return;
+      seenGeneration = m_generation;
+    }
+
+    runChunks(idx);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_finished++;
+    }
+    m_done.notify_one();
+  }
+}
+
+void ThreadPool::runChunks(int idx)
+{
+  const int nThreads = threadCount();
+  auto runChunk = [this](int chunk) {
+    int begin = chunk * m_grain;
+    (*m_fn)(begin, std::min(begin + m_grain, m_count));
+  };
+
+  for(int chunk; (chunk = popFront(m_queues[idx])) >= 0; )
+    runChunk(chunk);
+
+  // try each of the other threads in turn, starting with the next one along so that the thieves
+  // spread themselves out.
+  for(int i = 1; i<nThreads; i++) {
+    ChunkQueue& victim = m_queues[(idx + i) % nThreads];
+    for(int chunk; (chunk = popBack(victim)) >= 0; )
+      runChunk(chunk);
+  }
+}
+
+int ThreadPool::popFront(ChunkQueue& queue)
+{
+  uint64_t range = queue.m_range.load(std::memory_order_relaxed);
+  for(;;) {
+    uint32_t begin = uint32_t(range);
+    uint32_t end = uint32_t(range >> 32);
+    if(begin >= end)
+      return -1;
+    if(queue.m_range.compare_exchange_weak(range, Pack(begin + 1, end), std::memory_order_relaxed))
+      return begin;
+  }
+}
+
+int ThreadPool::popBack(ChunkQueue& queue)
+{
+  uint64_t range = queue.m_range.load(std::memory_order_relaxed);
+  for(;;) {
+    uint32_t begin = uint32_t(range);
+    uint32_t end = uint32_t(range >> 32);
+    if(begin >= end)
+      return -1;
+    if(queue.m_range.compare_exchange_weak(range, Pack(begin, end - 1), std::memory_order_relaxed))
+      return end - 1;
+  }
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace icosahedron {
+
+/// A pool of worker threads for splitting a loop over the lights across cores.
+///
+/// parallelFor() cuts the loop into fixed size chunks which are dealt out evenly to every
+/// thread's queue up front. Each thread works from the front of its own queue and when that is
+/// empty steals from the back of the others, so a thread that gets slow chunks or is late waking
+/// up doesn't hold up the rest. The chunk boundaries only depend on the count and the grain, so as
+/// long as each chunk only writes its own items the output is the same whichever thread ran it.
+class ThreadPool {
+public:
+  typedef std::function<void(int begin, int end)> RangeCallback;
+
+  /// Creates a pool that uses nThreads threads including the caller of parallelFor(), 0 picks one
+  /// per core.
+  explicit ThreadPool(int nThreads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// Number of threads that work on each loop, including the calling thread.
+  int threadCount() const { return int(m_workers.size()) + 1; }
+
+  /// Stops the workers and starts nThreads - 1 new ones, 0 picks one per core.
+  void setThreadCount(int nThreads);
+
+  /// Calls fn(begin, end) for consecutive chunks of [0, count) of grain items, the last chunk may
+  /// be shorter, and returns once they have all been done. The calling thread does its share of
+  /// the chunks. Must not be called from inside fn.
+  void parallelFor(int count, int grain, const RangeCallback& fn);
+
+private:
+  /// The chunks dealt to one thread, the first and one past the last chunk index packed into a
+  /// single word so the owner and thieves can both take from it with one compare and swap.
+  struct alignas(64) ChunkQueue {
+    std::atomic<uint64_t> m_range{0};
+  };
+
+  static uint64_t Pack(uint32_t begin, uint32_t end) { return uint64_t(end) << 32 | begin; }
+
+  void startWorkers(int nThreads);
+  void stopWorkers();
+  /// Waits for loops newer than seenGeneration and does its share of each.
+  void workerMain(int idx, uint64_t seenGeneration);
+
+  /// Runs chunks from the given thread's queue and then any it can steal, until there are none
+  /// left anywhere.
+  void runChunks(int idx);
+
+  /// Takes the next chunk from the front of a queue, or from the back when stealing. Returns -1
+  /// if the queue is empty.
+  int popFront(ChunkQueue& queue);
+  int popBack(ChunkQueue& queue);
+
+  std::vector<std::thread> m_workers;
+  std::unique_ptr<ChunkQueue[]> m_queues;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  /// Incremented for every loop so the workers can tell a new one has started.
+  uint64_t m_generation = 0;
+  /// Number of workers that have finished with the current loop.
+  int m_finished = 0;
+  bool m_quit = false;
+
+  /// The loop being run, only valid while parallelFor() is running.
+  const RangeCallback *m_fn = nullptr;
+  int m_count = 0;
+  int m_grain = 1;
+};
+
+}
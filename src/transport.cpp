@@ -0,0 +1,56 @@
+#include "transport.hpp"
+#include "e131transport.hpp"
+#include "artnet.hpp"
+#include "ddp.hpp"
+
+bool ParseProtocol(const std::string& name, Protocol& protocol)
+{
+  if(name == "e131")
+    protocol = Protocol::E131;
+  else if(name == "artnet")
+    protocol = Protocol::ArtNet;
+  else if(name == "ddp")
+    protocol = Protocol::DDP;
+  else
+    return false;
+  return true;
+}
+
+const char *ProtocolName(Protocol protocol)
+{
+  switch(protocol) {
+  case Protocol::E131:
+    return "e131";
+  case Protocol::ArtNet:
+    return "artnet";
+  case Protocol::DDP:
+    return "ddp";
+  }
+  return "unknown";
+}
+
+std::shared_ptr<UniverseSender> CreateUniverseSender(Protocol protocol)
+{
+  switch(protocol) {
+  case Protocol::E131:
+    return std::make_shared<E131UniverseSender>();
+  case Protocol::ArtNet:
+    return std::make_shared<ArtNetUniverseSender>();
+  case Protocol::DDP:
+    return std::make_shared<DDPUniverseSender>();
+  }
+  return nullptr;
+}
+
+std::shared_ptr<UniverseReceiver> CreateUniverseReceiver(Protocol protocol)
+{
+  switch(protocol) {
+  case Protocol::E131:
+    return std::make_shared<E131UniverseReceiver>();
+  case Protocol::ArtNet:
+    return std::make_shared<ArtNetUniverseReceiver>();
+  case Protocol::DDP:
+    return nullptr;
+  }
+  return nullptr;
+}
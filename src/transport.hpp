@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// The network protocols that DMX universes can be sent and received with.
+enum class Protocol {
+  E131,
+  ArtNet,
+  /// Output only, there is no DDP receiver.
+  DDP
+};
+
+/// Parses a protocol name from the mapping file, "e131", "artnet" or "ddp". Returns false if it isn't
+/// one of them.
+bool ParseProtocol(const std::string& name, Protocol& protocol);
+const char *ProtocolName(Protocol protocol);
+
+/// Sends a run of consecutively numbered DMX universes to one controller.
+class UniverseSender {
+public:
+  virtual ~UniverseSender() {}
+
+  /// Makes the packets for slotCounts.size() universes numbered from firstUniverse, universe n
+  /// having slotCounts[n] DMX slots.
+  virtual void init(int firstUniverse, const std::vector<int>& slotCounts) = 0;
+
+  /// Opens a socket to the controller at ipAddr. Returns false if it can't.
+  virtual bool open(const char *ipAddr) = 0;
+  virtual void close() = 0;
+
+  virtual int numUniverses() const = 0;
+
+  /// The 512 DMX slots of universe n, starting at slot 1.
+  virtual uint8_t *slots(int n) = 0;
+
+  /// Is true if slots(n)[-1] is the start code and can be written to.
+  virtual bool hasStartCode() const = 0;
+
+  /// Is false when the protocol sends the lights as one run of pixel data rather than as DMX
+  /// universes. The universes' slots then follow on from each other, with no start address.
+  virtual bool isDmx() const { return true; }
+
+  /// Gets the first count universes ready to send, each with its next sequence number. If
+  /// syncUniverse isn't 0 the controller is told to hold them until sendSync(). Returns the
+  /// number of packets they go in, nothing is sent if the sender isn't open.
+  virtual size_t prepare(size_t count, uint16_t syncUniverse) = 0;
+
+  /// Sends num of the prepared packets from first, either all in one go or one at a time.
+  virtual void sendPrepared(size_t first, size_t num, bool batch) = 0;
+
+  /// Prepares and sends the first count universes straight away.
+  void send(size_t count, bool batch, uint16_t syncUniverse) {
+    sendPrepared(0, prepare(count, syncUniverse), batch);
+  }
+
+  /// Tells the controller to show the universes it is holding.
+  virtual void sendSync(uint16_t syncUniverse) = 0;
+};
+
+/// One universe of DMX data that a UniverseReceiver has read.
+struct ReceivedUniverse {
+  /// 16 bytes that identify the sender, unique across protocols.
+  const uint8_t *m_source = nullptr;
+  /// Universe number, counted from 1.
+  uint16_t m_universe = 0;
+  /// Sequence number, only valid if m_hasSequence.
+  uint8_t m_sequence = 0;
+  bool m_hasSequence = false;
+  /// E1.31 priority, 0-200.
+  uint8_t m_priority = 100;
+  /// Is true when the sender has said it is stopping, the data isn't valid.
+  bool m_terminated = false;
+  /// The DMX data, laid out as it is stored for the lights.
+  const uint8_t *m_data = nullptr;
+  int m_count = 0;
+};
+
+/// Reads DMX universes sent with one protocol.
+class UniverseReceiver {
+public:
+  typedef std::function<void(const ReceivedUniverse& universe)> Callback;
+
+  virtual ~UniverseReceiver() {}
+
+  /// Opens and binds the socket. Returns false if it can't.
+  virtual bool open() = 0;
+  virtual void close() = 0;
+
+  /// Reads every packet that is waiting without blocking and passes each universe in them to fn.
+  virtual void receive(const Callback& fn) = 0;
+};
+
+std::shared_ptr<UniverseSender> CreateUniverseSender(Protocol protocol);
+/// Returns null for a protocol that can't be received.
+std::shared_ptr<UniverseReceiver> CreateUniverseReceiver(Protocol protocol);